@@ -0,0 +1,123 @@
+/*=============================================================================
+Copyright (c) 2011, The Trustees of Indiana University
+All rights reserved.
+
+Authors: Michael Hansen (mihansen@indiana.edu), Shinya Ito
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of Indiana University nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+=============================================================================*/
+
+#include <iostream>
+#include <vector>
+#include <ctime>
+#include <cmath>
+#include <climits>
+
+#include <boost/multi_array.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_01.hpp>
+
+#include "transent.hpp"
+
+// Microbenchmark for the transent kernels on random Poisson-like spike trains.
+// Usage: bench_transent [series] [duration] [rate]
+
+typedef int TimeType;
+typedef std::vector<TimeType> TimeSeries;
+typedef std::vector<TimeSeries> TimeSeriesCollection;
+typedef boost::multi_array<double, 2> ResultMatrix;
+
+// Returns the maximum absolute difference between two result matrices
+double max_difference(const ResultMatrix& a, const ResultMatrix& b) {
+  double diff = 0;
+
+  for (std::size_t i = 0; i < a.shape()[0]; ++i) {
+    for (std::size_t j = 0; j < a.shape()[1]; ++j) {
+      diff = std::max(diff, std::fabs(a[i][j] - b[i][j]));
+    }
+  }
+
+  return (diff);
+}
+
+// Prints one benchmark line and returns the elapsed seconds
+double report(const char* name, std::clock_t start, std::size_t pairs) {
+  const double seconds = (double)(std::clock() - start) / CLOCKS_PER_SEC;
+
+  std::cout << name << ": " << seconds << " s, "
+            << (pairs / seconds) << " pairs/s" << std::endl;
+
+  return (seconds);
+}
+
+int main(int argc, char **argv) {
+
+  const std::size_t num_series = (argc > 1) ? atoi(argv[1]) : 64;
+  const TimeType duration = (argc > 2) ? atoi(argv[2]) : 1000000;
+  const double rate = (argc > 3) ? atof(argv[3]) : 0.01;
+
+  // Random spike trains with per-series rates in [0.5, 1.5] * rate
+  boost::mt19937 rng(42);
+  boost::uniform_01<boost::mt19937&> uniform(rng);
+
+  TimeSeriesCollection all_series(num_series);
+
+  for (std::size_t i = 0; i < num_series; ++i) {
+    const double series_rate = rate * (0.5 + uniform());
+
+    for (TimeType t = 1; t <= duration; ++t) {
+      if (uniform() < series_rate) {
+        all_series[i].push_back(t);
+      }
+    }
+
+    // Terminating element
+    all_series[i].push_back(INT_MAX);
+  }
+
+  const std::size_t pairs = num_series * num_series;
+  ResultMatrix generic_result(boost::extents[num_series][num_series]),
+               result(boost::extents[num_series][num_series]);
+
+  std::cout << num_series << " series, duration " << duration
+            << ", rate " << rate << std::endl;
+
+  // First order
+  std::clock_t start = std::clock();
+  transent_ho<TimeSeriesCollection, ResultMatrix, 1, 1>
+    (all_series, 1, duration, generic_result);
+  const double generic_seconds = report("transent_ho<1, 1>", start, pairs);
+
+  start = std::clock();
+  transent_1(all_series, 1, duration, result);
+  const double seconds = report("transent_1", start, pairs);
+
+  std::cout << "  speedup " << (generic_seconds / seconds)
+            << ", max difference " << max_difference(generic_result, result)
+            << std::endl;
+
+  return (0);
+}
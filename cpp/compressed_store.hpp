@@ -0,0 +1,415 @@
+/*=============================================================================
+Copyright (c) 2011, The Trustees of Indiana University
+All rights reserved.
+
+Authors: Michael Hansen (mihansen@indiana.edu), Shinya Ito
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of Indiana University nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+=============================================================================*/
+
+#ifndef COMPRESSED_STORE_HPP
+#define COMPRESSED_STORE_HPP
+
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <cstddef>
+#include <cassert>
+
+#include <boost/cstdint.hpp>
+#include <boost/limits.hpp>
+#include <boost/thread/tss.hpp>
+
+#ifdef __SSE2__
+  #include <emmintrin.h>
+#endif
+
+// Spikes per compressed block
+#define COMPRESSED_BLOCK_SIZE 128
+
+// Decoded blocks kept per thread (an even number)
+#ifndef COMPRESSED_CACHE_BLOCKS
+  #define COMPRESSED_CACHE_BLOCKS 16
+#endif
+
+// Compressed block header. The block holds the absolute time of its first
+// spike followed by bit-packed deltas of the remaining spikes.
+template <typename TimeType>
+struct CompressedBlock {
+  TimeType first;
+  boost::uint32_t offset;   // First 32-bit word of the packed deltas
+  boost::uint32_t bits;     // Bits per delta
+};
+
+// Decodes one block of deltas into absolute times. The packed deltas are
+// unpacked first and then turned into times with a prefix sum (4 lanes at a
+// time when SSE2 is available).
+template <typename TimeType>
+void decode_compressed_block(const CompressedBlock<TimeType>& block,
+                             const boost::uint32_t* words, std::size_t count,
+                             TimeType* times) {
+
+  const boost::uint32_t bits = block.bits;
+  const boost::uint64_t mask = (bits == 32) ? 0xFFFFFFFFull : ((1ull << bits) - 1);
+  const boost::uint32_t* block_words = words + block.offset;
+
+  // Unpack deltas (times[0] gets a zero delta)
+  times[0] = 0;
+  std::size_t bit_pos = 0;
+
+  for (std::size_t k = 1; k < count; ++k, bit_pos += bits) {
+    const std::size_t word = bit_pos >> 5, shift = bit_pos & 31;
+    boost::uint64_t window = block_words[word];
+
+    if ((shift + bits) > 32) {
+      window |= ((boost::uint64_t)block_words[word + 1] << 32);
+    }
+
+    times[k] = (TimeType)((window >> shift) & mask);
+  }
+
+  // Prefix sum
+  std::size_t k = 0;
+  TimeType carry = block.first;
+
+#ifdef __SSE2__
+  if (sizeof(TimeType) == 4) {
+    __m128i carry_vec = _mm_set1_epi32(carry);
+
+    for (; (k + 4) <= count; k += 4) {
+      __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(times + k));
+      x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+      x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+      x = _mm_add_epi32(x, carry_vec);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(times + k), x);
+      carry_vec = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+
+    carry = (k > 0) ? times[k - 1] : carry;
+  }
+#endif
+
+  for (; k < count; ++k) {
+    carry += times[k];
+    times[k] = carry;
+  }
+}
+
+template <typename TimeType>
+class CompressedSpikeStore;
+
+// Decoded blocks of the calling thread, shared by all of its iterators, so
+// the history iterators of a series that sit in the same block decode it once
+// between them. Blocks are looked up by their store-wide index in sets of two
+// slots (the least recently used one is replaced): the neighbouring blocks of
+// one series fall into different sets, and the blocks of an x and a y series
+// that share a set get a slot each.
+template <typename TimeType>
+struct CompressedBlockCache {
+  struct Slot {
+    const CompressedSpikeStore<TimeType>* store;
+    std::size_t block;
+    TimeType times[COMPRESSED_BLOCK_SIZE];
+  };
+
+  Slot slots[COMPRESSED_CACHE_BLOCKS];
+  std::size_t recent[COMPRESSED_CACHE_BLOCKS / 2];
+
+  CompressedBlockCache() {
+    for (std::size_t k = 0; k < COMPRESSED_CACHE_BLOCKS; ++k) {
+      slots[k].store = 0;
+      slots[k].block = 0;
+    }
+
+    std::fill(recent, recent + (COMPRESSED_CACHE_BLOCKS / 2), 0);
+  }
+
+  // Returns the decoded times of block (count spikes) of store
+  const TimeType* find(const CompressedSpikeStore<TimeType>* store,
+                       std::size_t block, std::size_t count) {
+
+    const std::size_t set = block % (COMPRESSED_CACHE_BLOCKS / 2);
+    Slot* ways = slots + (2 * set);
+
+    for (std::size_t way = 0; way < 2; ++way) {
+      if ((ways[way].block == block) && (ways[way].store == store)) {
+        recent[set] = way;
+        return (ways[way].times);
+      }
+    }
+
+    recent[set] = 1 - recent[set];
+
+    Slot& slot = ways[recent[set]];
+    store->decode(block, count, slot.times);
+    slot.store = store;
+    slot.block = block;
+
+    return (slot.times);
+  }
+
+  // Returns the cache of the calling thread
+  static CompressedBlockCache& local() {
+    static boost::thread_specific_ptr<CompressedBlockCache> cache;
+
+    if (cache.get() == 0) {
+      cache.reset(new CompressedBlockCache());
+    }
+
+    return (*cache);
+  }
+};
+
+// Random access iterator over a compressed time series. Blocks are decoded
+// into the CompressedBlockCache of the thread that created the iterator, so
+// an iterator must only be used on that thread. Dereferencing the end
+// iterator yields the maximum TimeType value (like a terminating element).
+template <typename TimeType>
+class CompressedIterator {
+public:
+  typedef std::random_access_iterator_tag iterator_category;
+  typedef TimeType value_type;
+  typedef std::ptrdiff_t difference_type;
+  typedef const TimeType* pointer;
+  typedef TimeType reference;
+
+  CompressedIterator() :
+    store_(0), cache_(0), first_block_(0), size_(0), pos_(0) { }
+
+  CompressedIterator(const CompressedSpikeStore<TimeType>* store,
+                     std::size_t first_block, std::size_t size, std::size_t pos) :
+    store_(store), cache_(&CompressedBlockCache<TimeType>::local()),
+    first_block_(first_block), size_(size), pos_(pos) { }
+
+  TimeType operator*() const {
+    if (pos_ >= size_) {
+      return (std::numeric_limits<TimeType>::max());
+    }
+
+    const std::size_t block = pos_ / COMPRESSED_BLOCK_SIZE;
+    const TimeType* times =
+      cache_->find(store_, first_block_ + block,
+                   std::min<std::size_t>(COMPRESSED_BLOCK_SIZE, size_ - (block * COMPRESSED_BLOCK_SIZE)));
+
+    return (times[pos_ % COMPRESSED_BLOCK_SIZE]);
+  }
+
+  TimeType operator[](difference_type n) const { return (*(*this + n)); }
+
+  CompressedIterator& operator++() { ++pos_; return (*this); }
+  CompressedIterator& operator--() { --pos_; return (*this); }
+  CompressedIterator operator++(int) { CompressedIterator it(*this); ++pos_; return (it); }
+  CompressedIterator operator--(int) { CompressedIterator it(*this); --pos_; return (it); }
+
+  CompressedIterator& operator+=(difference_type n) { pos_ += n; return (*this); }
+  CompressedIterator& operator-=(difference_type n) { pos_ -= n; return (*this); }
+
+  CompressedIterator operator+(difference_type n) const { CompressedIterator it(*this); it.pos_ += n; return (it); }
+  CompressedIterator operator-(difference_type n) const { CompressedIterator it(*this); it.pos_ -= n; return (it); }
+
+  difference_type operator-(const CompressedIterator& other) const {
+    return ((difference_type)pos_ - (difference_type)other.pos_);
+  }
+
+  bool operator==(const CompressedIterator& other) const { return (pos_ == other.pos_); }
+  bool operator!=(const CompressedIterator& other) const { return (pos_ != other.pos_); }
+  bool operator<(const CompressedIterator& other) const { return (pos_ < other.pos_); }
+  bool operator>(const CompressedIterator& other) const { return (pos_ > other.pos_); }
+  bool operator<=(const CompressedIterator& other) const { return (pos_ <= other.pos_); }
+  bool operator>=(const CompressedIterator& other) const { return (pos_ >= other.pos_); }
+
+  // Same as std::lower_bound(*this, last, value), but the blocks are searched
+  // by the first time in their headers, so only the block that holds the
+  // result is decoded
+  template <typename Value>
+  CompressedIterator lower_bound(const CompressedIterator& last, const Value& value) const {
+
+    if (pos_ >= last.pos_) {
+      return (*this);
+    }
+
+    // First block after ours whose first time is not below value
+    std::size_t low = (pos_ / COMPRESSED_BLOCK_SIZE) + 1,
+                high = ((last.pos_ - 1) / COMPRESSED_BLOCK_SIZE) + 1;
+
+    while (low < high) {
+      const std::size_t middle = low + ((high - low) / 2);
+
+      if (store_->block_first(first_block_ + middle) < value) {
+        low = middle + 1;
+      }
+      else {
+        high = middle;
+      }
+    }
+
+    // The result is in the block before it
+    CompressedIterator first(*this), block_last(*this);
+    first.pos_ = std::max(pos_, (low - 1) * COMPRESSED_BLOCK_SIZE);
+    block_last.pos_ = std::min(last.pos_, low * COMPRESSED_BLOCK_SIZE);
+
+    return (std::lower_bound(first, block_last, value));
+  }
+
+private:
+  const CompressedSpikeStore<TimeType>* store_;
+  CompressedBlockCache<TimeType>* cache_;
+  std::size_t first_block_, size_, pos_;
+};
+
+// History search of the transent kernels (see transent_lower_bound)
+template <typename TimeType, typename Value>
+CompressedIterator<TimeType> transent_lower_bound
+(CompressedIterator<TimeType> first, CompressedIterator<TimeType> last,
+ const Value& value) {
+  return (first.lower_bound(last, value));
+}
+
+// Read-only view of a single compressed time series.
+template <typename TimeType>
+class CompressedSeries {
+public:
+  typedef TimeType value_type;
+  typedef CompressedIterator<TimeType> iterator;
+  typedef CompressedIterator<TimeType> const_iterator;
+
+  CompressedSeries(const CompressedSpikeStore<TimeType>* store,
+                   std::size_t first_block, std::size_t size) :
+    store_(store), first_block_(first_block), size_(size) { }
+
+  const_iterator begin() const { return (const_iterator(store_, first_block_, size_, 0)); }
+  const_iterator end() const { return (const_iterator(store_, first_block_, size_, size_)); }
+
+  std::size_t size() const { return (size_); }
+  bool empty() const { return (size_ == 0); }
+
+private:
+  const CompressedSpikeStore<TimeType>* store_;
+  std::size_t first_block_, size_;
+};
+
+// Spike store that keeps every time series as delta-encoded, bit-packed
+// blocks of COMPRESSED_BLOCK_SIZE spikes. Each block uses the smallest bit
+// width that fits its largest delta, so sparse trains with regular firing
+// typically need 8-12 bits per spike instead of 32. Can be passed to the
+// transent functions as the TimeSeriesCollection.
+template <typename TimeType>
+class CompressedSpikeStore {
+public:
+  typedef CompressedSeries<TimeType> value_type;
+
+  CompressedSpikeStore() : series_blocks_(1, 0) { }
+
+  // Appends a time series. Times must be sorted in ascending order.
+  template <typename Iterator>
+  void push_back(Iterator first, Iterator last) {
+
+    std::size_t count = 0;
+
+    while (first != last) {
+      CompressedBlock<TimeType> block;
+      TimeType values[COMPRESSED_BLOCK_SIZE];
+      std::size_t block_count = 0;
+
+      for (; (first != last) && (block_count < COMPRESSED_BLOCK_SIZE); ++first) {
+        values[block_count++] = *first;
+      }
+
+      // Smallest bit width for the deltas of this block
+      boost::uint32_t max_delta = 0;
+
+      for (std::size_t k = 1; k < block_count; ++k) {
+        assert(values[k] >= values[k - 1]);
+        max_delta = std::max(max_delta, (boost::uint32_t)(values[k] - values[k - 1]));
+      }
+
+      block.first = values[0];
+      block.offset = words_.size();
+      block.bits = 0;
+
+      while ((block.bits < 32) && ((max_delta >> block.bits) != 0)) {
+        ++block.bits;
+      }
+
+      // Pack deltas (one spare word so decoding can always read two words)
+      const std::size_t total_bits = (block_count - 1) * block.bits;
+      words_.resize(words_.size() + ((total_bits + 31) / 32) + 1, 0);
+
+      std::size_t bit_pos = 0;
+      for (std::size_t k = 1; k < block_count; ++k, bit_pos += block.bits) {
+        const boost::uint64_t delta = (boost::uint32_t)(values[k] - values[k - 1]);
+        const std::size_t word = block.offset + (bit_pos >> 5), shift = bit_pos & 31;
+
+        words_[word] |= (boost::uint32_t)(delta << shift);
+
+        if ((shift + block.bits) > 32) {
+          words_[word + 1] |= (boost::uint32_t)(delta >> (32 - shift));
+        }
+      }
+
+      blocks_.push_back(block);
+      count += block_count;
+    }
+
+    series_sizes_.push_back(count);
+    series_blocks_.push_back(blocks_.size());
+  }
+
+  template <typename TimeSeries>
+  void push_back(const TimeSeries& series) {
+    push_back(series.begin(), series.end());
+  }
+
+  value_type operator[](std::size_t i) const {
+    return (value_type(this, series_blocks_[i], series_sizes_[i]));
+  }
+
+  std::size_t size() const { return (series_sizes_.size()); }
+
+  // Approximate memory used by the compressed data
+  std::size_t bytes() const {
+    return ((words_.size() * sizeof(boost::uint32_t)) +
+            (blocks_.size() * sizeof(CompressedBlock<TimeType>)) +
+            (series_sizes_.size() * sizeof(std::size_t) * 2));
+  }
+
+  // Decodes block (count spikes) into times
+  void decode(std::size_t block, std::size_t count, TimeType* times) const {
+    decode_compressed_block(blocks_[block], words_.data(), count, times);
+  }
+
+  // Time of the first spike in block
+  TimeType block_first(std::size_t block) const {
+    return (blocks_[block].first);
+  }
+
+private:
+  std::vector<boost::uint32_t> words_;
+  std::vector< CompressedBlock<TimeType> > blocks_;
+  std::vector<std::size_t> series_sizes_, series_blocks_;
+};
+
+#endif // COMPRESSED_STORE_HPP
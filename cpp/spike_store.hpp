@@ -0,0 +1,159 @@
+/*=============================================================================
+Copyright (c) 2011, The Trustees of Indiana University
+All rights reserved.
+
+Authors: Michael Hansen (mihansen@indiana.edu), Shinya Ito
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of Indiana University nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+=============================================================================*/
+
+#ifndef SPIKE_STORE_HPP
+#define SPIKE_STORE_HPP
+
+#include <vector>
+#include <cstddef>
+
+#include <boost/limits.hpp>
+
+// Read-only view of a single time series inside a SpikeStore. Provides the
+// subset of the container interface used by the transent functions.
+template <typename TimeType>
+class SpikeSeries {
+public:
+  typedef TimeType value_type;
+  typedef const TimeType* iterator;
+  typedef const TimeType* const_iterator;
+
+  SpikeSeries() : first_(0), last_(0) { }
+  SpikeSeries(const TimeType* first, const TimeType* last) :
+    first_(first), last_(last) { }
+
+  const_iterator begin() const { return (first_); }
+  const_iterator end() const { return (last_); }
+
+  std::size_t size() const { return (last_ - first_); }
+  bool empty() const { return (first_ == last_); }
+
+  const TimeType& operator[](std::size_t i) const { return (first_[i]); }
+
+private:
+  const TimeType* first_;
+  const TimeType* last_;
+};
+
+// Non-owning view of a contiguous spike store. Series i occupies
+// times[offsets[i]] .. times[offsets[i + 1] - 2] and is followed by a
+// terminating element (the maximum TimeType value), so offsets has
+// (size + 1) entries. Used when the storage lives somewhere else, e.g. in a
+// shared memory segment.
+template <typename TimeType>
+class SpikeStoreView {
+public:
+  typedef SpikeSeries<TimeType> value_type;
+
+  SpikeStoreView() : times_(0), offsets_(0), size_(0) { }
+  SpikeStoreView(const TimeType* times, const std::size_t* offsets,
+                 std::size_t size) :
+    times_(times), offsets_(offsets), size_(size) { }
+
+  value_type operator[](std::size_t i) const {
+    return (value_type(times_ + offsets_[i], times_ + offsets_[i + 1] - 1));
+  }
+
+  std::size_t size() const { return (size_); }
+
+private:
+  const TimeType* times_;
+  const std::size_t* offsets_;
+  std::size_t size_;
+};
+
+// Owning contiguous spike store. All time series are packed into a single
+// array (see SpikeStoreView for the layout), which keeps the data compact
+// and makes it cheap to send or map as one block.
+template <typename TimeType>
+class SpikeStore {
+public:
+  typedef SpikeSeries<TimeType> value_type;
+
+  SpikeStore() : offsets_(1, 0) { }
+
+  // Appends a time series. Times must be sorted in ascending order.
+  template <typename Iterator>
+  void push_back(Iterator first, Iterator last) {
+    times_.insert(times_.end(), first, last);
+    times_.push_back(std::numeric_limits<TimeType>::max());
+    offsets_.push_back(times_.size());
+  }
+
+  template <typename TimeSeries>
+  void push_back(const TimeSeries& series) {
+    push_back(series.begin(), series.end());
+  }
+
+  void reserve(std::size_t series, std::size_t spikes) {
+    offsets_.reserve(series + 1);
+    times_.reserve(spikes + series);
+  }
+
+  void clear() {
+    times_.clear();
+    offsets_.assign(1, 0);
+  }
+
+  void swap(SpikeStore& other) {
+    times_.swap(other.times_);
+    offsets_.swap(other.offsets_);
+  }
+
+  value_type operator[](std::size_t i) const {
+    return (value_type(times_.data() + offsets_[i],
+                       times_.data() + offsets_[i + 1] - 1));
+  }
+
+  std::size_t size() const { return (offsets_.size() - 1); }
+
+  // Number of spikes in series i (terminator excluded)
+  std::size_t spikes(std::size_t i) const {
+    return (offsets_[i + 1] - offsets_[i] - 1);
+  }
+
+  SpikeStoreView<TimeType> view() const {
+    return (SpikeStoreView<TimeType>(times_.data(), offsets_.data(), size()));
+  }
+
+  // Raw storage (times include the terminators)
+  std::vector<TimeType>& times() { return (times_); }
+  const std::vector<TimeType>& times() const { return (times_); }
+  std::vector<std::size_t>& offsets() { return (offsets_); }
+  const std::vector<std::size_t>& offsets() const { return (offsets_); }
+
+private:
+  std::vector<TimeType> times_;
+  std::vector<std::size_t> offsets_;
+};
+
+#endif // SPIKE_STORE_HPP
@@ -0,0 +1,354 @@
+/*=============================================================================
+Copyright (c) 2011, The Trustees of Indiana University
+All rights reserved.
+
+Authors: Michael Hansen (mihansen@indiana.edu), Shinya Ito
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of Indiana University nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+=============================================================================*/
+
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+
+#include <boost/atomic.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/multi_array.hpp>
+#include <boost/program_options.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "transent.hpp"
+#include "spike_store.hpp"
+#include "te_io.hpp"
+#include "te_parse.hpp"
+
+// Typedefs
+typedef int TimeType;
+typedef SpikeStore<TimeType> TimeSeriesCollection;
+
+typedef boost::multi_array<double, 2> ResultMatrix;
+
+// Rows per work item handed to a worker
+#define BATCH_ROW_TILE 16
+
+// A job of the manifest: one block of one dataset with one parameter set
+struct BatchJob {
+  std::string in_file_path, out_file_path, out_format;
+  std::size_t x_order, y_order, y_delay;
+  std::size_t row_start, rows, col_start, cols;
+  std::size_t line;
+  ResultMatrix* te_result;
+};
+
+// Rows [first_row, first_row + rows) of a job
+struct BatchItem {
+  std::size_t job, first_row, rows;
+};
+
+// Work shared by the workers for one dataset
+struct BatchTask {
+  const TimeSeriesCollection* all_series;
+  TimeType duration;
+  std::vector<BatchJob>* jobs;
+  std::vector<BatchItem> items;
+  boost::atomic<std::size_t> next_item;
+};
+
+// Rows of a job's result matrix shifted by a fixed offset
+struct BatchRows {
+  ResultMatrix* te_result;
+  std::size_t shift;
+
+  ResultMatrix::reference operator[](std::size_t i) const {
+    return ((*te_result)[i + shift]);
+  }
+};
+
+// Parses one manifest line of "key=value" fields into job. Returns false with
+// error set for an unknown key, a bad value or a missing path.
+bool parse_batch_job(const std::string& line, BatchJob& job, std::string& error) {
+
+  std::istringstream fields(line);
+  std::string field;
+
+  job.out_format = "binary";
+  job.x_order = job.y_order = job.y_delay = 1;
+  job.row_start = job.rows = job.col_start = job.cols = 0;
+  job.te_result = 0;
+
+  while (fields >> field) {
+    const std::size_t equals = field.find('=');
+
+    if (equals == std::string::npos) {
+      error = "expected key=value, got " + field;
+      return (false);
+    }
+
+    const std::string key = field.substr(0, equals), value = field.substr(equals + 1);
+
+    try {
+      if (key == "in") { job.in_file_path = value; }
+      else if (key == "out") { job.out_file_path = value; }
+      else if (key == "out-format") { job.out_format = value; }
+      else if (key == "x-order") { job.x_order = boost::lexical_cast<std::size_t>(value); }
+      else if (key == "y-order") { job.y_order = boost::lexical_cast<std::size_t>(value); }
+      else if (key == "y-delay") { job.y_delay = boost::lexical_cast<std::size_t>(value); }
+      else if (key == "row-start") { job.row_start = boost::lexical_cast<std::size_t>(value); }
+      else if (key == "rows") { job.rows = boost::lexical_cast<std::size_t>(value); }
+      else if (key == "col-start") { job.col_start = boost::lexical_cast<std::size_t>(value); }
+      else if (key == "cols") { job.cols = boost::lexical_cast<std::size_t>(value); }
+      else {
+        error = "unknown key " + key;
+        return (false);
+      }
+    }
+    catch (const boost::bad_lexical_cast&) {
+      error = "bad value for " + key;
+      return (false);
+    }
+  }
+
+  if (job.in_file_path.empty() || job.out_file_path.empty()) {
+    error = "in and out are required";
+    return (false);
+  }
+
+  if ((job.out_format != "text") && (job.out_format != "binary")) {
+    error = "out-format must be text or binary";
+    return (false);
+  }
+
+  if ((job.x_order == 0) || (job.y_order == 0) || (job.y_delay == 0) ||
+      ((1 + job.x_order + job.y_order) > MAX_XY_ORDER)) {
+    error = "orders and delay must be positive, with a combined order of at most " +
+            boost::lexical_cast<std::string>(MAX_XY_ORDER);
+    return (false);
+  }
+
+  return (true);
+}
+
+// Orders jobs by dataset, then by manifest line
+struct BatchJobOrder {
+  bool operator()(const BatchJob& a, const BatchJob& b) const {
+    return ((a.in_file_path < b.in_file_path) ||
+            ((a.in_file_path == b.in_file_path) && (a.line < b.line)));
+  }
+};
+
+// Takes the next work item until none are left
+void batch_work(BatchTask& task) {
+
+  while (true) {
+    const std::size_t k = task.next_item.fetch_add(1);
+
+    if (k >= task.items.size()) {
+      break;
+    }
+
+    const BatchItem& item = task.items[k];
+    const BatchJob& job = (*task.jobs)[item.job];
+    BatchRows rows = { job.te_result, item.first_row };
+
+    transent_ho(*task.all_series, job.x_order, job.y_order, (TimeType)job.y_delay,
+                task.duration, rows, job.row_start + item.first_row, item.rows,
+                job.col_start, job.cols);
+  }
+}
+
+int main(int argc, char *argv[]) {
+
+  namespace opt = boost::program_options;
+  namespace pt = boost::posix_time;
+
+  opt::options_description desc("Runs a manifest of transfer entropy jobs (y -> x), reading every dataset once");
+  desc.add_options()
+    ("help", "Show this help message")
+    ("manifest", opt::value<std::string>(), "Job manifest: one job per line of key=value fields (in, out, out-format, x-order, y-order, y-delay, row-start, rows, col-start, cols)")
+    ("threads", opt::value<std::size_t>()->default_value(0), "Worker threads shared by all jobs (default 0 for all cores)")
+    ;
+
+  opt::variables_map opt_vars;
+  opt::store(opt::parse_command_line(argc, argv, desc), opt_vars);
+  opt::notify(opt_vars);
+
+  if (opt_vars.count("help")) {
+    std::cout << desc << std::endl;
+    return (0);
+  }
+
+  if (!opt_vars.count("manifest")) {
+    std::cout << "A manifest file path is required" << std::endl;
+    return (0);
+  }
+
+  std::size_t threads = opt_vars["threads"].as<std::size_t>();
+
+  if (threads == 0) {
+    threads = boost::thread::hardware_concurrency();
+  }
+
+  // Read in the whole manifest before running anything
+  std::ifstream manifest_file(opt_vars["manifest"].as<std::string>().c_str());
+
+  if (!manifest_file) {
+    std::cout << "Unable to read manifest " << opt_vars["manifest"].as<std::string>() << std::endl;
+    return (0);
+  }
+
+  std::vector<BatchJob> jobs;
+  std::string line, error;
+
+  for (std::size_t line_number = 1; getline(manifest_file, line); ++line_number) {
+    const std::size_t first = line.find_first_not_of(" \t\r");
+
+    if ((first == std::string::npos) || (line[first] == '#')) {
+      continue;
+    }
+
+    BatchJob job;
+    job.line = line_number;
+
+    if (!parse_batch_job(line, job, error)) {
+      std::cout << "Manifest line " << line_number << ": " << error << std::endl;
+      return (0);
+    }
+
+    jobs.push_back(job);
+  }
+
+  // Jobs of a dataset run together on the data read once
+  std::sort(jobs.begin(), jobs.end(), BatchJobOrder());
+
+  const pt::ptime start_time = pt::microsec_clock::universal_time();
+  std::size_t datasets = 0, failed = 0;
+
+  for (std::size_t first = 0; first < jobs.size(); ) {
+    std::size_t last = first + 1;
+
+    while ((last < jobs.size()) && (jobs[last].in_file_path == jobs[first].in_file_path)) {
+      ++last;
+    }
+
+    TimeSeriesCollection all_series;
+    TimeType duration;
+
+    ++datasets;
+
+    if (!read_time_series_mapped(jobs[first].in_file_path, all_series, duration, error, threads)) {
+      std::cout << "Unable to read input file " << jobs[first].in_file_path
+                << " (" << error << "); skipping " << (last - first) << " job(s)" << std::endl;
+      failed += last - first;
+      first = last;
+      continue;
+    }
+
+    BatchTask task;
+    task.all_series = &all_series;
+    task.duration = duration;
+    task.jobs = &jobs;
+    task.next_item.store(0);
+
+    std::vector<ResultMatrix*> results;
+
+    for (std::size_t j = first; j < last; ++j) {
+      BatchJob& job = jobs[j];
+
+      std::ptrdiff_t row_start = job.row_start, rows = job.rows,
+                     col_start = job.col_start, cols = job.cols;
+      std::string block_error;
+
+      if (!resolve_block(job.in_file_path, all_series.size(), row_start, rows, col_start, cols, block_error)) {
+        std::cout << "Manifest line " << job.line << ": " << block_error << std::endl;
+        ++failed;
+        continue;
+      }
+
+      job.rows = rows;
+      job.cols = cols;
+
+      job.te_result = new ResultMatrix(boost::extents[job.rows][job.cols]);
+      results.push_back(job.te_result);
+
+      for (std::size_t r = 0; r < job.rows; r += BATCH_ROW_TILE) {
+        BatchItem item = { j, r, std::min((std::size_t)BATCH_ROW_TILE, job.rows - r) };
+        task.items.push_back(item);
+      }
+    }
+
+    // Workers share the items of all jobs of this dataset
+    boost::thread_group workers;
+
+    for (std::size_t t = 1; t < threads; ++t) {
+      workers.create_thread(boost::bind(&batch_work, boost::ref(task)));
+    }
+
+    batch_work(task);
+    workers.join_all();
+
+    for (std::size_t j = first; j < last; ++j) {
+      const BatchJob& job = jobs[j];
+
+      if (!job.te_result) {
+        continue;
+      }
+
+      if (job.out_format == "binary") {
+        ResultHeader header;
+        header.set_parameters(job.x_order, job.y_order, job.y_delay, duration);
+        header.series_count = all_series.size();
+        header.row_start = job.row_start;
+        header.rows = job.rows;
+        header.col_start = job.col_start;
+        header.cols = job.cols;
+
+        std::ofstream out_file(job.out_file_path.c_str(), std::ios::binary);
+        write_result_binary(out_file, *job.te_result, header);
+      }
+      else {
+        std::ofstream out_file(job.out_file_path.c_str());
+        write_result_text(out_file, *job.te_result, job.rows, job.cols);
+      }
+    }
+
+    for (std::size_t k = 0; k < results.size(); ++k) {
+      delete results[k];
+    }
+
+    first = last;
+  }
+
+  std::cout << "Jobs: " << jobs.size() << " (" << failed << " failed), datasets: " << datasets
+            << ", time: " << ((pt::microsec_clock::universal_time() - start_time).total_microseconds() / 1e6)
+            << " s" << std::endl;
+
+  return (0);
+}
@@ -39,17 +39,161 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <boost/limits.hpp>
 #include <boost/multi_array.hpp>
 #include <boost/program_options.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #include "transent.hpp"
+#include "spike_store.hpp"
+#include "compressed_store.hpp"
+#include "te_io.hpp"
+#include "te_pipeline.hpp"
+#include "te_cache.hpp"
+#include "te_parallel.hpp"
+#include "te_estimate.hpp"
+#include "te_parse.hpp"
+#include "te_tiled.hpp"
+
+#ifdef TE_HDF5
+  #include "te_nwb.hpp"
+#endif
 
 // Typedefs
 typedef int TimeType;
-typedef std::vector<TimeType> TimeSeries;
-typedef std::vector< std::vector<TimeType> > TimeSeriesCollection;
+typedef SpikeStore<TimeType> TimeSeriesCollection;
 
 typedef boost::multi_array<double, 2> ResultMatrix;
 typedef ResultMatrix::index arr_index;
 
+typedef std::vector< std::pair<TimeType, TimeType> > TrialList;
+
+// Pairs whose local transfer entropy is held in memory at once (--local-file)
+#define TE_LOCAL_BATCH 256
+
+// Calculates a piece of the block with the run-time transent_ho, over the
+// given trials only, on worker threads or on compressed time series if set
+struct BlockCalculation {
+  const TimeSeriesCollection* all_series;
+  const CompressedSpikeStore<TimeType>* compressed_series;
+  const TrialList* trials;
+  TransentParallel<TimeType>* parallel;
+  std::size_t x_order, y_order;
+  TimeType y_delay, duration;
+
+  template <typename PieceMatrix>
+  void operator()(PieceMatrix& te_result,
+                  std::size_t row_start, std::size_t rows,
+                  std::size_t col_start, std::size_t cols) const {
+
+    if (trials) {
+      transent_ho_trials(*all_series, x_order, y_order, y_delay, *trials, te_result,
+                         row_start, rows, col_start, cols);
+    }
+    else if (parallel) {
+      parallel->transent_ho(x_order, y_order, y_delay, duration, te_result,
+                            row_start, rows, col_start, cols);
+    }
+    else if (compressed_series) {
+      transent_ho(*compressed_series, x_order, y_order, y_delay, duration, te_result,
+                  row_start, rows, col_start, cols);
+    }
+    else {
+      transent_ho(*all_series, x_order, y_order, y_delay, duration, te_result,
+                  row_start, rows, col_start, cols);
+    }
+  }
+};
+
+// Writes a result block in the given output format. Binary headers record
+// the orders, delay and duration of parameters, if set.
+template <typename BlockMatrix>
+void write_block(const std::string& out_file_path, const std::string& out_format,
+                 const BlockMatrix& te_result, std::size_t series_count,
+                 std::size_t row_start, std::size_t rows,
+                 std::size_t col_start, std::size_t cols,
+                 const ResultHeader* parameters = 0) {
+
+  if (out_format == "binary") {
+    ResultHeader header;
+
+    if (parameters) {
+      header.set_parameters(parameters->x_order, parameters->y_order,
+                            parameters->y_delay, parameters->duration);
+    }
+
+    header.series_count = series_count;
+    header.row_start = row_start;
+    header.rows = rows;
+    header.col_start = col_start;
+    header.cols = cols;
+
+    std::ofstream out_file(out_file_path.c_str(), std::ios::binary);
+    write_result_binary(out_file, te_result, header);
+  }
+  else {
+    std::ofstream out_file(out_file_path.c_str());
+    write_result_text(out_file, te_result, rows, cols);
+  }
+}
+
+// Copies a (rows)x(cols) block into another result matrix type
+template <typename BlockMatrix>
+void copy_block(const ResultMatrix& te_result, BlockMatrix& block_result,
+                std::size_t rows, std::size_t cols) {
+
+  for (std::size_t i = 0; i < rows; ++i) {
+    for (std::size_t j = 0; j < cols; ++j) {
+      block_result[i][j] = te_result[i][j];
+    }
+  }
+}
+
+// Writes a block of doubles stored with the given precision (log-quantised
+// values scaled by log_scale, an upper bound of all values)
+void write_block_precision(const std::string& out_file_path, const std::string& out_format,
+                           ResultValueType precision, double log_scale,
+                           const ResultMatrix& te_result, std::size_t series_count,
+                           std::size_t row_start, std::size_t rows,
+                           std::size_t col_start, std::size_t cols) {
+
+  if (precision == RESULT_FLOAT32) {
+    CompactResultMatrix<Float32Codec> compact_result(rows, cols);
+    copy_block(te_result, compact_result, rows, cols);
+    write_block(out_file_path, out_format, compact_result, series_count, row_start, rows, col_start, cols);
+  }
+  else if (precision == RESULT_BFLOAT16) {
+    CompactResultMatrix<BFloat16Codec> compact_result(rows, cols);
+    copy_block(te_result, compact_result, rows, cols);
+    write_block(out_file_path, out_format, compact_result, series_count, row_start, rows, col_start, cols);
+  }
+  else if (precision == RESULT_FLOAT16) {
+    CompactResultMatrix<Float16Codec> compact_result(rows, cols);
+    copy_block(te_result, compact_result, rows, cols);
+    write_block(out_file_path, out_format, compact_result, series_count, row_start, rows, col_start, cols);
+  }
+  else if (precision == RESULT_LOG_UINT16) {
+    CompactResultMatrix<LogUInt16Codec> compact_result(rows, cols, LogUInt16Codec(log_scale));
+    copy_block(te_result, compact_result, rows, cols);
+    write_block(out_file_path, out_format, compact_result, series_count, row_start, rows, col_start, cols);
+  }
+  else {
+    write_block(out_file_path, out_format, te_result, series_count, row_start, rows, col_start, cols);
+  }
+}
+
+// Calculates a block, reading and adding cached tiles if cache is set
+template <typename BlockMatrix>
+void calculate_block(BlockMatrix& te_result, const BlockCalculation& calculation,
+                     const ResultCache* cache, std::size_t tile_size,
+                     std::size_t row_start, std::size_t rows,
+                     std::size_t col_start, std::size_t cols) {
+
+  if (cache) {
+    transent_cached(*cache, tile_size, te_result, row_start, rows, col_start, cols, calculation);
+  }
+  else {
+    calculation(te_result, row_start, rows, col_start, cols);
+  }
+}
+
 int main(int argc, char *argv[]) {
 
   namespace opt = boost::program_options;
@@ -65,7 +209,53 @@ int main(int argc, char *argv[]) {
     ("cols", opt::value<arr_index>()->default_value(0), "Columns in block (default 0 for remainder)")
     ("row-start", opt::value<arr_index>()->default_value(0), "Row offset of block (default 0)")
     ("rows", opt::value<arr_index>()->default_value(0), "Rows in block (default 0 for remainder)")
+    ("pairs-file", opt::value<std::string>(), "Optional file of \"predicted predictor\" index pairs; writes sparse output")
+    ("row-ids-file", opt::value<std::string>(), "Optional file of predicted series indices; writes sparse output")
+    ("col-ids-file", opt::value<std::string>(), "Optional file of predictor series indices; writes sparse output")
+    ("trials-file", opt::value<std::string>(), "Optional file with one trial per line (start and end time bin, inclusive)")
+    ("bin-factors", opt::value<std::string>(), "Optional comma-separated bin factors (e.g. 1,2,5,10,20); writes one output file per factor")
+    ("compress", "Keep time series in compressed form while calculating")
+    ("x-lags", opt::value<std::string>(), "Optional comma-separated lags of the x history (e.g. 1,3,10,30); replaces --x-order")
+    ("y-lags", opt::value<std::string>(), "Optional comma-separated lags of the y history; replaces --y-order and --y-delay")
+    ("alphabet", opt::value<std::size_t>()->default_value(2), "Symbols per time bin (spike counts 0 .. alphabet - 1, the last meaning that many or more; default 2 for binary)")
+    ("local-file", opt::value<std::string>(), "Optional file for the local (pointwise) TE of every selected pair; needs a sparse pair selection")
+    ("counts-file", opt::value<std::string>(), "Optional file for the joint count table of every pair in the block (compact binary, see README)")
+    ("segment-length", opt::value<std::size_t>()->default_value(0), "Time bins per segment for time-resolved TE (default 0 for off)")
+    ("window-segments", opt::value<std::size_t>()->default_value(1), "Segments per time-resolved window (default 1)")
+    ("window-step", opt::value<std::size_t>()->default_value(1), "Segments between time-resolved windows (default 1)")
+    ("ci", opt::value<std::string>(), "Optional confidence intervals from resampled --segment-length segments: jackknife or bootstrap")
+    ("replicates", opt::value<std::size_t>()->default_value(200), "Bootstrap replicates for --ci bootstrap (default 200)")
+    ("confidence", opt::value<double>()->default_value(0.95), "Confidence level of --ci intervals (default 0.95)")
+    ("seed", opt::value<boost::uint32_t>()->default_value(1), "Random seed of --ci bootstrap (default 1)")
+    ("out-format", opt::value<std::string>()->default_value("text"), "Output format: text or binary (default text)")
+    ("precision", opt::value<std::string>()->default_value("float64"), "Result storage: float64, float32, bfloat16, float16 or log-uint16 (default float64)")
+    ("pipeline", "Calculate rows while the input is still being read and write them as they finish")
+    ("threads", opt::value<std::size_t>()->default_value(0), "Worker threads for reading the input, --pipeline and --parallel (default 0 for all cores)")
+    ("parallel", "Calculate the block on --threads worker threads spread over the NUMA nodes")
+    ("numa", opt::value<std::string>()->default_value("replicate"), "Spike data placement for --parallel: replicate, interleave or off (default replicate)")
+    ("numa-stats", "Print per-node statistics of --parallel")
+    ("cache-dir", opt::value<std::string>(), "Optional directory of cached result tiles; only missing tiles are calculated")
+    ("update-from", opt::value<std::string>(), "Optional full binary result of a previous run; only pairs with changed time series are calculated")
+    ("diff-file", opt::value<std::string>(), "Time series changes since --update-from (added/removed/changed lines)")
+    ("estimate", "Only estimate memory, output size and run time from the spike counts")
+    ("memory-budget", opt::value<double>()->default_value(0), "Memory per job (MB) for splitting the block with --estimate, or for spike data and results with --out-of-core (default 0 for no limit)")
+    ("time-budget", opt::value<double>()->default_value(0), "Run time per job (s) for splitting the block with --estimate (default 0 for no limit)")
+    ("make-store", "Convert the ASCII --in-file into a spike store file at --out-file for --out-of-core")
+    ("out-of-core", "Read --in-file as a spike store file in row and column tiles within --memory-budget; needs --out-format binary")
+    ("cache-tile", opt::value<std::size_t>()->default_value(TE_CACHE_TILE), "Rows and columns per cached tile (default 256)")
+    ;
+
+#ifdef TE_HDF5
+  desc.add_options()
+    ("nwb", "Read --in-file as an NWB/HDF5 file of unit spike times")
+    ("bin-size", opt::value<double>()->default_value(0.001), "Time bin of --nwb input in seconds (default 0.001)")
+    ("start-bin", opt::value<boost::int64_t>()->default_value(0), "First time bin of --nwb input, as in ASDFChooseTime (default 0 for the first)")
+    ("end-bin", opt::value<boost::int64_t>()->default_value(0), "Last time bin of --nwb input, inclusive (default 0 for the last spike)")
+    ("unit-ids-file", opt::value<std::string>(), "Optional file of 0-based units to read from --nwb input, in output order, as in ASDFSubsample")
+    ("nwb-times", opt::value<std::string>()->default_value("/units/spike_times"), "Spike time dataset of --nwb input")
+    ("nwb-index", opt::value<std::string>()->default_value("/units/spike_times_index"), "Spike time index dataset of --nwb input")
     ;
+#endif
 
   opt::variables_map opt_vars;
   opt::store(opt::parse_command_line(argc, argv, desc), opt_vars);
@@ -105,53 +295,738 @@ int main(int argc, char *argv[]) {
             row_start = opt_vars["row-start"].as<arr_index>(),
             rows = opt_vars["rows"].as<arr_index>();
 
-  // Read in time series block
-  std::vector<TimeSeries> all_series;
+  std::string block_error;
+
+  const std::string out_format = opt_vars["out-format"].as<std::string>();
+
+  if ((out_format != "text") && (out_format != "binary")) {
+    std::cout << "Output format must be text or binary" << std::endl;
+    return (0);
+  }
+
+  ResultValueType precision;
+
+  if (!parse_result_precision(opt_vars["precision"].as<std::string>(), precision)) {
+    std::cout << "Precision must be float64, float32, bfloat16, float16 or log-uint16" << std::endl;
+    return (0);
+  }
+
+  const bool nwb_input = opt_vars.count("nwb");
+
+  if (nwb_input && (opt_vars.count("estimate") || opt_vars.count("pipeline") || opt_vars.count("bin-factors") ||
+                    opt_vars.count("make-store") || opt_vars.count("out-of-core"))) {
+    std::cout << "--estimate, --pipeline, --bin-factors, --make-store and --out-of-core need a text input file" << std::endl;
+    return (0);
+  }
+
+  const std::size_t alphabet = opt_vars["alphabet"].as<std::size_t>();
+
+  if (alphabet < 2) {
+    std::cout << "The alphabet must have at least 2 symbols" << std::endl;
+    return (0);
+  }
+
+  // Symbols, count tables, local TE and confidence intervals use dense tables
+  // of alphabet^(1 + x_order + y_order) counts; other binary runs count codes
+  // with CodeCounter up to MAX_XY_ORDER
+  const bool dense_tables = (alphabet > 2) || opt_vars.count("counts-file") ||
+                            opt_vars.count("local-file") || opt_vars.count("ci");
+
+  if (dense_tables &&
+      (std::pow((double)alphabet, (double)num_series) > (double)((std::size_t)1 << TRANSENT_TABLE_CODE_BITS))) {
+    std::cout << "With --alphabet above 2, --counts-file, --local-file or --ci, alphabet^(1 + x_order + y_order) cannot exceed 2^"
+              << TRANSENT_TABLE_CODE_BITS << std::endl;
+    return (0);
+  }
+
+  if (opt_vars.count("counts-file") &&
+      (opt_vars.count("estimate") || opt_vars.count("pipeline") || opt_vars.count("bin-factors") ||
+       opt_vars.count("pairs-file") || opt_vars.count("row-ids-file") || opt_vars.count("col-ids-file") ||
+       opt_vars.count("update-from") || opt_vars.count("x-lags") || opt_vars.count("y-lags") ||
+       opt_vars.count("trials-file") || (opt_vars["segment-length"].as<std::size_t>() > 0))) {
+    std::cout << "--counts-file only works for a plain block" << std::endl;
+    return (0);
+  }
+
+  // Trials and compressed time series are only used by the plain block
+  const bool other_paths =
+    opt_vars.count("pipeline") || opt_vars.count("bin-factors") || opt_vars.count("out-of-core") ||
+    opt_vars.count("pairs-file") || opt_vars.count("row-ids-file") || opt_vars.count("col-ids-file") ||
+    opt_vars.count("update-from") || opt_vars.count("x-lags") || opt_vars.count("y-lags") ||
+    opt_vars.count("counts-file") || opt_vars.count("ci") || (alphabet > 2) ||
+    (opt_vars["segment-length"].as<std::size_t>() > 0);
+
+  if (opt_vars.count("trials-file") && other_paths) {
+    std::cout << "--trials-file only works for a plain block" << std::endl;
+    return (0);
+  }
+
+  if (opt_vars.count("compress") &&
+      (other_paths || opt_vars.count("parallel") || opt_vars.count("trials-file"))) {
+    std::cout << "--compress only works for a plain block without --parallel and --trials-file" << std::endl;
+    return (0);
+  }
+
+  if ((precision != RESULT_FLOAT64) &&
+      (opt_vars.count("bin-factors") || (opt_vars["segment-length"].as<std::size_t>() > 0))) {
+    std::cout << "--precision only works without --bin-factors and --segment-length" << std::endl;
+    return (0);
+  }
+
+  if (opt_vars.count("local-file") &&
+      !(opt_vars.count("pairs-file") || opt_vars.count("row-ids-file") || opt_vars.count("col-ids-file"))) {
+    std::cout << "--local-file needs --pairs-file, --row-ids-file or --col-ids-file" << std::endl;
+    return (0);
+  }
+
+  // Dry run: estimate the cost from the spike counts and suggest a split
+  if (opt_vars.count("estimate")) {
+
+    TimeType duration;
+    std::vector<std::size_t> spike_counts;
+
+    if (!read_spike_counts(in_file_path, duration, spike_counts)) {
+      std::cout << "Unable to read input file " << in_file_path << std::endl;
+      return (0);
+    }
+
+    const std::size_t series_count = spike_counts.size();
+    std::size_t threads = 1;
+
+    if (opt_vars.count("parallel") || opt_vars.count("pipeline")) {
+      threads = opt_vars["threads"].as<std::size_t>();
+
+      if (threads == 0) {
+        threads = boost::thread::hardware_concurrency();
+      }
+    }
+
+    if (!resolve_block(in_file_path, series_count, row_start, rows, col_start, cols, block_error)) {
+      std::cout << block_error << std::endl;
+      return (0);
+    }
+
+    ResultHeader header;
+    header.value_type = precision;
+
+    TransentEstimate estimate = transent_estimate(spike_counts, x_order, y_order, (TimeType)y_delay, duration,
+                                                  row_start, rows, col_start, cols,
+                                                  header.value_size(), (out_format == "binary"), threads);
+    estimate.input_bytes = boost::filesystem::file_size(in_file_path);
+
+    write_estimate(std::cout, estimate);
 
-  std::ifstream in_file(in_file_path.c_str());
-  std::string line;
+    const double memory_budget = opt_vars["memory-budget"].as<double>() * 1024 * 1024,
+                 time_budget = opt_vars["time-budget"].as<double>();
 
-  getline(in_file, line);
-  TimeType duration = boost::lexical_cast<TimeType>(line);
+    if ((memory_budget > 0) || (time_budget > 0)) {
+      std::vector<double> row_units;
+      std::vector<std::size_t> row_bounds;
 
-  while (getline(in_file, line)) {
+      transent_row_units(spike_counts, x_order, y_order, row_start, rows, col_start, cols, row_units);
 
-    std::istringstream line_stream(line);
-    TimeSeries cur_series;
+      const bool fits = transent_split_rows(row_units, cols, estimate.model, threads,
+                                            estimate.count_table_bytes + estimate.spike_bytes,
+                                            (double)cols * header.value_size(),
+                                            time_budget, memory_budget, row_start, row_bounds);
+
+      std::cout << std::endl << "Suggested jobs: " << (row_bounds.size() - 1) << std::endl;
+
+      if (!fits) {
+        std::cout << "(some single rows exceed the budget)" << std::endl;
+      }
+
+      for (std::size_t b = 0; (b + 1) < row_bounds.size(); ++b) {
+        std::cout << "--row-start " << row_bounds[b] << " --rows " << (row_bounds[b + 1] - row_bounds[b])
+                  << " --col-start " << col_start << " --cols " << cols << std::endl;
+      }
+    }
+
+    return (0);
+  }
+
+  // Pipelined calculation: read, calculate and write at the same time
+  if (opt_vars.count("pipeline")) {
+
+    if (precision != RESULT_FLOAT64) {
+      std::cout << "--pipeline only writes float64 results" << std::endl;
+      return (0);
+    }
+
+    std::size_t threads = opt_vars["threads"].as<std::size_t>();
+
+    if (threads == 0) {
+      threads = boost::thread::hardware_concurrency();
+    }
+
+    bool pipeline_ok;
+
+    if (out_format == "binary") {
+      // Duration is the first line of the input file
+      std::ifstream in_file(in_file_path.c_str());
+      TimeType pipeline_duration = 0;
+      in_file >> pipeline_duration;
+
+      BinaryRowWriter writer(out_file_path);
+      writer.set_parameters(x_order, y_order, y_delay, pipeline_duration);
+      pipeline_ok = transent_ho_pipeline(in_file_path, x_order, y_order, (TimeType)y_delay,
+                                         row_start, rows, col_start, cols, threads, writer, block_error);
+    }
+    else {
+      TextRowWriter writer(out_file_path);
+      pipeline_ok = transent_ho_pipeline(in_file_path, x_order, y_order, (TimeType)y_delay,
+                                         row_start, rows, col_start, cols, threads, writer, block_error);
+    }
 
-    // This could be more efficient, but it's fast enough for now
-    std::copy(std::istream_iterator<TimeType>(line_stream),
-              std::istream_iterator<TimeType>(),
-              std::back_inserter(cur_series));
+    // Binary rows are written as they come, so drop the unfinished file
+    if (!pipeline_ok) {
+      std::cout << block_error << std::endl;
+      boost::filesystem::remove(out_file_path);
+    }
 
-    all_series.push_back(cur_series);
+    return (0);
   }
 
-  if (rows == 0) {
-    rows = all_series.size();
+  // Multi-resolution TE: rebin the input once for every factor and write one
+  // output file per factor (out-file.<factor>)
+  if (opt_vars.count("bin-factors")) {
+
+    std::vector<TimeType> factors;
+    std::istringstream factors_stream(opt_vars["bin-factors"].as<std::string>());
+    std::string factor;
+
+    while (getline(factors_stream, factor, ',')) {
+      factors.push_back(boost::lexical_cast<TimeType>(factor));
+    }
+
+    std::vector< SpikeStore<TimeType> > stores;
+    std::vector<TimeType> durations;
+
+    if (!read_time_series_pyramid(in_file_path, factors, stores, durations, alphabet > 2)) {
+      std::cout << "Unable to read input file " << in_file_path << std::endl;
+      return (0);
+    }
+
+    if (!resolve_block(in_file_path, stores[0].size(), row_start, rows, col_start, cols, block_error)) {
+      std::cout << block_error << std::endl;
+      return (0);
+    }
+
+    ResultMatrix te_result(boost::extents[rows][cols]);
+
+    for (std::size_t f = 0; f < factors.size(); ++f) {
+      if (alphabet > 2) {
+        transent_ho_symbols(stores[f], x_order, y_order, y_delay, durations[f], alphabet,
+                            te_result, row_start, rows, col_start, cols);
+      }
+      else {
+        transent_ho(stores[f], x_order, y_order, y_delay, durations[f], te_result,
+                    row_start, rows, col_start, cols);
+      }
+
+      write_block(out_file_path + "." + boost::lexical_cast<std::string>(factors[f]), out_format,
+                  te_result, stores[f].size(), row_start, rows, col_start, cols);
+    }
+
+    return (0);
   }
 
-  if (cols == 0) {
-    cols = all_series.size();
+  // Convert the input into a spike store file for --out-of-core
+  if (opt_vars.count("make-store")) {
+    if (!write_spike_store_file<TimeType>(in_file_path, out_file_path)) {
+      std::cout << "Unable to convert input file " << in_file_path << std::endl;
+    }
+
+    return (0);
   }
 
-  // Calculate TE
-  ResultMatrix te_result(boost::extents[rows][cols]);
+  // Out-of-core calculation: only a row tile and a column tile of the time
+  // series are in memory at a time
+  if (opt_vars.count("out-of-core")) {
+
+    const double memory_budget = opt_vars["memory-budget"].as<double>() * 1024 * 1024;
+
+    if ((out_format != "binary") || (precision != RESULT_FLOAT64) || (alphabet > 2) ||
+        opt_vars.count("pairs-file") || opt_vars.count("row-ids-file") || opt_vars.count("col-ids-file") ||
+        opt_vars.count("trials-file") || opt_vars.count("x-lags") || opt_vars.count("y-lags") ||
+        opt_vars.count("cache-dir") || opt_vars.count("update-from") || opt_vars.count("counts-file") ||
+        (opt_vars["segment-length"].as<std::size_t>() > 0)) {
+      std::cout << "--out-of-core only works for a plain block with float64 binary output" << std::endl;
+      return (0);
+    }
+
+    SpikeStoreFile<TimeType> store_file;
+
+    if (!store_file.open(in_file_path)) {
+      std::cout << "Unable to read spike store file " << in_file_path << std::endl;
+      return (0);
+    }
+
+    if (!resolve_block(in_file_path, store_file.size(), row_start, rows, col_start, cols, block_error)) {
+      std::cout << block_error << std::endl;
+      return (0);
+    }
 
-  transent_ho(all_series, x_order, y_order, y_delay, duration, te_result,
-              row_start, rows, col_start, cols);
+    BinaryRowWriter writer(out_file_path);
+    writer.set_parameters(x_order, y_order, y_delay, store_file.duration());
 
-  // Write results
-  std::ofstream out_file(out_file_path.c_str());
+    TiledStats stats;
 
-  for (arr_index i = 0; i < rows; ++i) {
-    for (arr_index j = 0; j < cols; ++j) {
-      out_file << te_result[j][i] << " ";
+    // Nothing is written if a single series does not fit the budget, so drop
+    // the empty file
+    if (!transent_ho_tiled(store_file, x_order, y_order, (TimeType)y_delay,
+                           (memory_budget > 0) ? memory_budget : std::numeric_limits<double>::max(),
+                           writer, row_start, rows, col_start, cols, stats, block_error)) {
+      std::cout << block_error << std::endl;
+      boost::filesystem::remove(out_file_path);
+      return (0);
     }
 
-    out_file << std::endl;
+    std::cout << "Row tiles: " << stats.row_tiles << ", column tiles: " << stats.col_tiles
+              << ", spike data read: " << (stats.bytes_read / (1024.0 * 1024.0)) << " MB"
+              << ", peak tile memory: " << (stats.peak_bytes / (1024.0 * 1024.0)) << " MB" << std::endl;
+
+    return (0);
+  }
+
+  // Read in time series block (parsed on --threads threads)
+  TimeSeriesCollection all_series;
+  TimeType duration;
+  std::string read_error;
+
+  bool read_ok = false;
+
+  if (nwb_input) {
+#ifdef TE_HDF5
+    NwbReadOptions nwb_options;
+    nwb_options.times_path = opt_vars["nwb-times"].as<std::string>();
+    nwb_options.index_path = opt_vars["nwb-index"].as<std::string>();
+    nwb_options.bin_seconds = opt_vars["bin-size"].as<double>();
+    nwb_options.start_bin = opt_vars["start-bin"].as<boost::int64_t>();
+    nwb_options.end_bin = opt_vars["end-bin"].as<boost::int64_t>();
+    nwb_options.keep_counts = (alphabet > 2);
+
+    if (opt_vars.count("unit-ids-file") &&
+        !read_index_list(opt_vars["unit-ids-file"].as<std::string>(), nwb_options.units)) {
+      std::cout << "Unable to read unit list" << std::endl;
+      return (0);
+    }
+
+    read_ok = read_nwb_spike_times(in_file_path, nwb_options, all_series, duration, read_error);
+#endif
+  }
+  else {
+    read_ok = read_time_series_mapped(in_file_path, all_series, duration, read_error,
+                                      opt_vars["threads"].as<std::size_t>());
+  }
+
+  if (!read_ok) {
+    std::cout << "Unable to read input file " << in_file_path << " (" << read_error << ")" << std::endl;
+    return (0);
+  }
+
+  // Sparse pair selection
+  if (opt_vars.count("pairs-file") || opt_vars.count("row-ids-file") || opt_vars.count("col-ids-file")) {
+
+    std::vector< std::pair<std::size_t, std::size_t> > pairs;
+
+    if (!read_sparse_selection(opt_vars.count("pairs-file") ? opt_vars["pairs-file"].as<std::string>() : std::string(),
+                               opt_vars.count("row-ids-file") ? opt_vars["row-ids-file"].as<std::string>() : std::string(),
+                               opt_vars.count("col-ids-file") ? opt_vars["col-ids-file"].as<std::string>() : std::string(),
+                               all_series.size(), pairs)) {
+      std::cout << "Unable to read pair selection" << std::endl;
+      return (0);
+    }
+
+    std::vector<double> te_values(pairs.size());
+
+    // Local TE, calculated and written in batches of pairs; out-file gets the
+    // averages
+    if (opt_vars.count("local-file")) {
+
+      std::ofstream local_file(opt_vars["local-file"].as<std::string>().c_str(),
+                               (out_format == "binary") ? std::ios::binary : std::ios::out);
+      std::vector< std::pair<std::size_t, std::size_t> > batch;
+      std::vector< TransentLocalSeries<TimeType> > locals;
+
+      for (std::size_t first = 0; first < pairs.size(); first += TE_LOCAL_BATCH) {
+        batch.assign(pairs.begin() + first,
+                     pairs.begin() + std::min(first + TE_LOCAL_BATCH, pairs.size()));
+
+        transent_local_pairs(all_series, x_order, y_order, y_delay, duration, alphabet,
+                             batch, locals, opt_vars["threads"].as<std::size_t>());
+
+        if (out_format == "binary") {
+          write_local_result_binary(local_file, batch, locals);
+        }
+        else {
+          write_local_result_text(local_file, batch, locals);
+        }
+
+        for (std::size_t p = 0; p < batch.size(); ++p) {
+          te_values[first + p] = locals[p].average;
+        }
+      }
+
+      std::ofstream out_file(out_file_path.c_str());
+      write_sparse_result_text(out_file, pairs, te_values);
+
+      return (0);
+    }
+
+    transent_ho_pairs(all_series, x_order, y_order, y_delay, duration,
+                      pairs, te_values);
+
+    std::ofstream out_file(out_file_path.c_str());
+    write_sparse_result_text(out_file, pairs, te_values);
+
+    return (0);
+  }
+
+  const std::size_t series_count = all_series.size();
+
+  // Incremental update of a previous full matrix
+  if (opt_vars.count("update-from")) {
+
+    std::ifstream previous_file(opt_vars["update-from"].as<std::string>().c_str(), std::ios::binary);
+    ResultHeader previous_header;
+    std::vector<double> previous_values;
+
+    if (!read_result_binary(previous_file, previous_header, previous_values) ||
+        (previous_header.row_start != 0) || (previous_header.col_start != 0) ||
+        (previous_header.rows != previous_header.series_count) ||
+        (previous_header.cols != previous_header.series_count)) {
+      std::cout << "Previous result must be a full binary result matrix" << std::endl;
+      return (0);
+    }
+
+    ResultHeader parameters;
+    parameters.set_parameters(x_order, y_order, y_delay, duration);
+
+    if (!previous_header.has_parameters()) {
+      std::cout << "Previous result does not record the orders, delay and duration it was "
+                << "calculated with" << std::endl;
+      return (0);
+    }
+
+    if ((previous_header.x_order != parameters.x_order) ||
+        (previous_header.y_order != parameters.y_order) ||
+        (previous_header.y_delay != parameters.y_delay) ||
+        (previous_header.duration != parameters.duration)) {
+      std::cout << "Previous result was calculated with x-order " << previous_header.x_order
+                << ", y-order " << previous_header.y_order
+                << ", y-delay " << previous_header.y_delay
+                << " and duration " << previous_header.duration << std::endl;
+      return (0);
+    }
+
+    std::vector<std::size_t> previous_index;
+
+    if (!opt_vars.count("diff-file") ||
+        !read_series_diff(opt_vars["diff-file"].as<std::string>(), previous_header.series_count,
+                          series_count, previous_index)) {
+      std::cout << "Unable to read a diff file matching the previous result" << std::endl;
+      return (0);
+    }
+
+    boost::const_multi_array_ref<double, 2> previous_result(previous_values.data(),
+      boost::extents[previous_header.rows][previous_header.cols]);
+
+    ResultMatrix te_result(boost::extents[series_count][series_count]);
+
+    transent_ho_update(all_series, x_order, y_order, y_delay, duration,
+                       previous_result, previous_index, te_result);
+
+    write_block(out_file_path, out_format, te_result, series_count,
+                0, series_count, 0, series_count, &parameters);
+
+    return (0);
+  }
+
+  if (!resolve_block(in_file_path, series_count, row_start, rows, col_start, cols, block_error)) {
+    std::cout << block_error << std::endl;
+    return (0);
+  }
+
+  // Non-uniform embedding: histories at explicit lags
+  if (opt_vars.count("x-lags") || opt_vars.count("y-lags")) {
+
+    std::vector<std::size_t> x_lags, y_lags;
+
+    if (!parse_lag_list(opt_vars.count("x-lags") ? opt_vars["x-lags"].as<std::string>() : std::string(),
+                        x_order, 1, x_lags) ||
+        !parse_lag_list(opt_vars.count("y-lags") ? opt_vars["y-lags"].as<std::string>() : std::string(),
+                        y_order, y_delay, y_lags) ||
+        ((1 + x_lags.size() + y_lags.size()) > TRANSENT_TABLE_CODE_BITS)) {
+      std::cout << "Lags must be positive integers, at most " << (TRANSENT_TABLE_CODE_BITS - 1)
+                << " in total" << std::endl;
+      return (0);
+    }
+
+    ResultMatrix te_result(boost::extents[rows][cols]);
+
+    transent_ho_lags(all_series, x_lags, y_lags, duration, te_result,
+                     row_start, rows, col_start, cols);
+
+    write_block_precision(out_file_path, out_format, precision,
+                          transent_lags_upper_bound(all_series, x_lags, y_lags, duration, row_start, rows),
+                          te_result, series_count, row_start, rows, col_start, cols);
+
+    return (0);
+  }
+
+  // Joint count tables of every pair, written next to the results (with the
+  // history layout of the compile-time transent_ho)
+  if (opt_vars.count("counts-file")) {
+
+    ResultMatrix te_result(boost::extents[rows][cols]);
+
+    CountTableHeader header;
+    header.x_order = x_order;
+    header.y_order = y_order;
+    header.y_delay = y_delay;
+    header.alphabet = alphabet;
+    header.end_time = duration - std::max(y_order + y_delay, x_order + 1) + 1;
+    header.series_count = series_count;
+    header.row_start = row_start;
+    header.rows = rows;
+    header.col_start = col_start;
+    header.cols = cols;
+
+    CountTableWriter writer(opt_vars["counts-file"].as<std::string>(), header);
+
+    transent_ho_count_tables(all_series, x_order, y_order, y_delay, duration, alphabet,
+                             writer, te_result, row_start, rows, col_start, cols);
+
+    if (!writer.close()) {
+      std::cout << "Unable to write count tables" << std::endl;
+    }
+
+    ResultHeader parameters;
+    parameters.set_parameters(x_order, y_order, y_delay, duration);
+
+    write_block(out_file_path, out_format, te_result, series_count,
+                row_start, rows, col_start, cols, &parameters);
+
+    return (0);
+  }
+
+  // Spike-count symbols: repeated times in a series are several spikes in one
+  // bin
+  if (alphabet > 2) {
+
+    ResultMatrix te_result(boost::extents[rows][cols]);
+
+    transent_ho_symbols(all_series, x_order, y_order, y_delay, duration, alphabet,
+                        te_result, row_start, rows, col_start, cols);
+
+    write_block_precision(out_file_path, out_format, precision,
+                          transent_upper_bound(all_series, x_order, y_order, y_delay, duration,
+                                               row_start, rows, alphabet),
+                          te_result, series_count, row_start, rows, col_start, cols);
+
+    return (0);
+  }
+
+  const std::size_t segment_length = opt_vars["segment-length"].as<std::size_t>();
+
+  if (opt_vars.count("ci")) {
+
+    // Confidence intervals: out-file holds the estimate, out-file.mean,
+    // out-file.se, out-file.lower and out-file.upper the resampling results
+    const std::string ci = opt_vars["ci"].as<std::string>();
+    const double confidence = opt_vars["confidence"].as<double>();
+
+    if ((segment_length == 0) || ((ci != "jackknife") && (ci != "bootstrap")) ||
+        (confidence <= 0) || (confidence >= 1)) {
+      std::cout << "--ci needs jackknife or bootstrap, --segment-length and a confidence in (0, 1)" << std::endl;
+      return (0);
+    }
+
+    boost::multi_array<TransentInterval, 2> te_intervals(boost::extents[rows][cols]);
+
+    transent_ho_intervals(all_series, x_order, y_order, y_delay, duration, segment_length,
+                          (ci == "jackknife") ? RESAMPLE_JACKKNIFE : RESAMPLE_BOOTSTRAP,
+                          opt_vars["replicates"].as<std::size_t>(), confidence,
+                          opt_vars["seed"].as<boost::uint32_t>(),
+                          te_intervals, row_start, rows, col_start, cols);
+
+    double TransentInterval::* const fields[] = {
+      &TransentInterval::estimate, &TransentInterval::mean, &TransentInterval::std_error,
+      &TransentInterval::lower, &TransentInterval::upper
+    };
+    const char* const suffixes[] = { "", ".mean", ".se", ".lower", ".upper" };
+
+    ResultMatrix te_result(boost::extents[rows][cols]);
+
+    for (std::size_t f = 0; f < 5; ++f) {
+      for (arr_index i = 0; i < rows; ++i) {
+        for (arr_index j = 0; j < cols; ++j) {
+          te_result[i][j] = te_intervals[i][j].*fields[f];
+        }
+      }
+
+      write_block(out_file_path + suffixes[f], out_format, te_result, series_count,
+                  row_start, rows, col_start, cols);
+    }
+
+    return (0);
+  }
+
+  if (segment_length > 0) {
+
+    // Time-resolved TE: one output file per window (out-file.0, out-file.1, ...)
+    const std::size_t window_segments = opt_vars["window-segments"].as<std::size_t>(),
+                      window_step = opt_vars["window-step"].as<std::size_t>();
+
+    assert(window_segments > 0);
+    assert(window_step > 0);
+
+    ResultMatrix te_result(boost::extents[rows][cols]);
+
+    SegmentCountIndex index;
+    transent_segment_index(all_series, x_order, y_order, y_delay, duration,
+                           segment_length, index, row_start, rows, col_start, cols);
+
+    std::size_t window_index = 0;
+    for (std::size_t first = 0; (first + window_segments) <= index.segments(); first += window_step) {
+      index.transent(first, first + window_segments, te_result);
+
+      write_block(out_file_path + "." + boost::lexical_cast<std::string>(window_index++), out_format,
+                  te_result, series_count, row_start, rows, col_start, cols);
+    }
+
+    return (0);
+  }
+
+  BlockCalculation calculation = { &all_series, 0, 0, 0, x_order, y_order, (TimeType)y_delay, duration };
+  TrialList trials;
+
+  if (opt_vars.count("trials-file")) {
+
+    // Read in trials
+    std::ifstream trials_file(opt_vars["trials-file"].as<std::string>().c_str());
+    TimeType trial_start, trial_end;
+
+    while (trials_file >> trial_start >> trial_end) {
+      trials.push_back(std::make_pair(trial_start, trial_end));
+    }
+
+    std::sort(trials.begin(), trials.end());
+    calculation.trials = &trials;
+  }
+
+  // Cache key: the input and everything else that affects the result
+  // (--compress does not)
+  ResultHasher hasher;
+
+  if (opt_vars.count("cache-dir")) {
+    hasher.add_value(TE_CACHE_VERSION);
+    hasher.add_string("transent_ho");
+    hasher.add_value(x_order);
+    hasher.add_value(y_order);
+    hasher.add_value(y_delay);
+    hasher.add_value(duration);
+    hasher.add_series(all_series);
+    hasher.add_value(calculation.trials != 0);
+
+    for (std::size_t t = 0; t < trials.size(); ++t) {
+      hasher.add_value(trials[t].first);
+      hasher.add_value(trials[t].second);
+    }
+  }
+
+  // Scale of log-quantised results: an upper bound of all TE values in the
+  // block (1 bit, the largest possible, for trials)
+  const double log_scale = calculation.trials ? 1.0 :
+    transent_upper_bound(all_series, x_order, y_order, y_delay, duration, row_start, rows);
+
+  // Worker threads, with their own copies of the time series
+  boost::scoped_ptr< TransentParallel<TimeType> > parallel;
+
+  if (opt_vars.count("parallel") && !calculation.trials) {
+    const std::string numa = opt_vars["numa"].as<std::string>();
+    std::size_t threads = opt_vars["threads"].as<std::size_t>();
+
+    if (threads == 0) {
+      threads = boost::thread::hardware_concurrency();
+    }
+
+    if ((numa != "replicate") && (numa != "interleave") && (numa != "off")) {
+      std::cout << "NUMA placement must be replicate, interleave or off" << std::endl;
+      return (0);
+    }
+
+    parallel.reset(new TransentParallel<TimeType>(all_series,
+      (numa == "replicate") ? NUMA_REPLICATE : ((numa == "interleave") ? NUMA_INTERLEAVE : NUMA_OFF),
+      threads));
+
+    TimeSeriesCollection().swap(all_series);
+    calculation.parallel = parallel.get();
+  }
+
+  CompressedSpikeStore<TimeType> compressed_series;
+
+  if (opt_vars.count("compress")) {
+
+    for (std::size_t i = 0; i < all_series.size(); ++i) {
+      compressed_series.push_back(all_series[i]);
+    }
+
+    TimeSeriesCollection().swap(all_series);
+    calculation.compressed_series = &compressed_series;
+  }
+
+  boost::scoped_ptr<ResultCache> cache;
+  const std::size_t tile_size = opt_vars["cache-tile"].as<std::size_t>();
+
+  if (opt_vars.count("cache-dir")) {
+    assert(tile_size > 0);
+    cache.reset(new ResultCache(opt_vars["cache-dir"].as<std::string>(), hasher.digest(), series_count));
+  }
+
+  // Orders, delay and duration recorded in binary results for --update-from
+  // (not for trials)
+  ResultHeader parameters;
+  parameters.set_parameters(x_order, y_order, y_delay, duration);
+
+  const ResultHeader* plain_parameters = calculation.trials ? 0 : &parameters;
+
+  // Calculate TE and write results
+  if (precision == RESULT_FLOAT32) {
+    CompactResultMatrix<Float32Codec> te_result(rows, cols);
+    calculate_block(te_result, calculation, cache.get(), tile_size, row_start, rows, col_start, cols);
+    write_block(out_file_path, out_format, te_result, series_count, row_start, rows, col_start, cols,
+                plain_parameters);
+  }
+  else if (precision == RESULT_BFLOAT16) {
+    CompactResultMatrix<BFloat16Codec> te_result(rows, cols);
+    calculate_block(te_result, calculation, cache.get(), tile_size, row_start, rows, col_start, cols);
+    write_block(out_file_path, out_format, te_result, series_count, row_start, rows, col_start, cols,
+                plain_parameters);
+  }
+  else if (precision == RESULT_FLOAT16) {
+    CompactResultMatrix<Float16Codec> te_result(rows, cols);
+    calculate_block(te_result, calculation, cache.get(), tile_size, row_start, rows, col_start, cols);
+    write_block(out_file_path, out_format, te_result, series_count, row_start, rows, col_start, cols,
+                plain_parameters);
+  }
+  else if (precision == RESULT_LOG_UINT16) {
+    CompactResultMatrix<LogUInt16Codec> te_result(rows, cols, LogUInt16Codec(log_scale));
+    calculate_block(te_result, calculation, cache.get(), tile_size, row_start, rows, col_start, cols);
+    write_block(out_file_path, out_format, te_result, series_count, row_start, rows, col_start, cols,
+                plain_parameters);
+  }
+  else {
+    ResultMatrix te_result(boost::extents[rows][cols]);
+    calculate_block(te_result, calculation, cache.get(), tile_size, row_start, rows, col_start, cols);
+    write_block(out_file_path, out_format, te_result, series_count, row_start, rows, col_start, cols,
+                plain_parameters);
+  }
+
+  if (parallel && opt_vars.count("numa-stats")) {
+    write_numa_stats(std::cout, parallel->topology(), parallel->stats());
   }
 
   return (0);
 }
-
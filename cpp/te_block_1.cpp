@@ -43,6 +43,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <boost/program_options.hpp>
 
 #include "transent.hpp"
+#include "te_io.hpp"
 
 // Typedefs
 typedef int TimeType;
@@ -64,6 +65,9 @@ int main(int argc, char *argv[]) {
     ("cols", opt::value<arr_index>()->default_value(0), "Columns in block (default 0 for remainder)")
     ("row-start", opt::value<arr_index>()->default_value(0), "Row offset of block (default 0)")
     ("rows", opt::value<arr_index>()->default_value(0), "Rows in block (default 0 for remainder)")
+    ("pairs-file", opt::value<std::string>(), "Optional file of \"predicted predictor\" index pairs; writes sparse output")
+    ("row-ids-file", opt::value<std::string>(), "Optional file of predicted series indices; writes sparse output")
+    ("col-ids-file", opt::value<std::string>(), "Optional file of predictor series indices; writes sparse output")
     ;
 
   opt::variables_map opt_vars;
@@ -116,6 +120,29 @@ int main(int argc, char *argv[]) {
     all_series.push_back(cur_series);
   }
 
+  // Sparse pair selection
+  if (opt_vars.count("pairs-file") || opt_vars.count("row-ids-file") || opt_vars.count("col-ids-file")) {
+
+    std::vector< std::pair<std::size_t, std::size_t> > pairs;
+
+    if (!read_sparse_selection(opt_vars.count("pairs-file") ? opt_vars["pairs-file"].as<std::string>() : std::string(),
+                               opt_vars.count("row-ids-file") ? opt_vars["row-ids-file"].as<std::string>() : std::string(),
+                               opt_vars.count("col-ids-file") ? opt_vars["col-ids-file"].as<std::string>() : std::string(),
+                               all_series.size(), pairs)) {
+      std::cout << "Unable to read pair selection" << std::endl;
+      return (0);
+    }
+
+    std::vector<double> te_values(pairs.size());
+
+    transent_1_pairs(all_series, y_delay, duration, pairs, te_values);
+
+    std::ofstream out_file(out_file_path.c_str());
+    write_sparse_result_text(out_file, pairs, te_values);
+
+    return (0);
+  }
+
   if (rows == 0) {
     rows = all_series.size();
   }
@@ -40,8 +40,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <boost/limits.hpp>
 #include <boost/multi_array.hpp>
 #include <boost/program_options.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include "transent.hpp"
+#include "te_io.hpp"
 
 #ifndef X_ORDER
   #define X_ORDER 1
@@ -51,6 +53,12 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
   #define Y_ORDER 1
 #endif
 
+// Lag masks for non-uniform histories (bit a - 1 for lag a, see
+// transent_ho_lags); replace the orders and --y-delay for full blocks
+#if defined(X_LAG_MASK) && !defined(Y_LAG_MASK)
+  #define Y_LAG_MASK 1
+#endif
+
 // Typedefs
 typedef int TimeType;
 typedef std::vector<TimeType> TimeSeries;
@@ -76,6 +84,12 @@ int main(int argc, char *argv[]) {
     ("cols", opt::value<arr_index>()->default_value(0), "Columns in block (default 0 for remainder)")
     ("row-start", opt::value<arr_index>()->default_value(0), "Row offset of block (default 0)")
     ("rows", opt::value<arr_index>()->default_value(0), "Rows in block (default 0 for remainder)")
+    ("pairs-file", opt::value<std::string>(), "Optional file of \"predicted predictor\" index pairs; writes sparse output")
+    ("row-ids-file", opt::value<std::string>(), "Optional file of predicted series indices; writes sparse output")
+    ("col-ids-file", opt::value<std::string>(), "Optional file of predictor series indices; writes sparse output")
+    ("screen-threshold", opt::value<double>(), "Screen the block with first-order TE and calculate only pairs at or above this value; writes sparse output")
+    ("screen-top", opt::value<std::size_t>()->default_value(0), "Calculate at most this many screened pairs per row (default 0 for all that pass)")
+    ("screen-file", opt::value<std::string>(), "Optional output file for the first-order screen of the block")
     ;
 
   opt::variables_map opt_vars;
@@ -138,6 +152,31 @@ int main(int argc, char *argv[]) {
     all_series.push_back(cur_series);
   }
 
+  // Sparse pair selection
+  if (opt_vars.count("pairs-file") || opt_vars.count("row-ids-file") || opt_vars.count("col-ids-file")) {
+
+    std::vector< std::pair<std::size_t, std::size_t> > pairs;
+
+    if (!read_sparse_selection(opt_vars.count("pairs-file") ? opt_vars["pairs-file"].as<std::string>() : std::string(),
+                               opt_vars.count("row-ids-file") ? opt_vars["row-ids-file"].as<std::string>() : std::string(),
+                               opt_vars.count("col-ids-file") ? opt_vars["col-ids-file"].as<std::string>() : std::string(),
+                               all_series.size(), pairs)) {
+      std::cout << "Unable to read pair selection" << std::endl;
+      return (0);
+    }
+
+    std::vector<double> te_values(pairs.size());
+
+    transent_ho_pairs<TimeSeriesCollection, std::vector< std::pair<std::size_t, std::size_t> >,
+                      std::vector<double>, x_order, y_order>
+      (all_series, y_delay, duration, pairs, te_values);
+
+    std::ofstream out_file(out_file_path.c_str());
+    write_sparse_result_text(out_file, pairs, te_values);
+
+    return (0);
+  }
+
   if (rows == 0) {
     rows = all_series.size();
   }
@@ -146,12 +185,75 @@ int main(int argc, char *argv[]) {
     cols = all_series.size();
   }
 
+  // Screening cascade: first-order TE for the block, high order for the pairs
+  // that pass
+  if (opt_vars.count("screen-threshold") || (opt_vars["screen-top"].as<std::size_t>() > 0)) {
+
+    namespace pt = boost::posix_time;
+
+    const double threshold = opt_vars.count("screen-threshold") ?
+      opt_vars["screen-threshold"].as<double>() : 0;
+    const std::size_t top_k = opt_vars["screen-top"].as<std::size_t>();
+
+    // transent_1 needs terminated time series; transent_ho ignores the
+    // terminators
+    for (std::size_t i = 0; i < all_series.size(); ++i) {
+      all_series[i].push_back(std::numeric_limits<TimeType>::max());
+    }
+
+    ResultMatrix screen_result(boost::extents[rows][cols]);
+    std::vector< std::pair<std::size_t, std::size_t> > pairs;
+    std::vector<double> te_values;
+
+    const pt::ptime start = pt::microsec_clock::universal_time();
+
+    transent_1(all_series, y_delay, duration, screen_result,
+               row_start, rows, col_start, cols);
+
+    const pt::ptime screened = pt::microsec_clock::universal_time();
+
+    transent_screen_pairs(screen_result, threshold, top_k, pairs,
+                          row_start, rows, col_start, cols);
+
+    te_values.resize(pairs.size());
+
+    transent_ho_pairs<TimeSeriesCollection, std::vector< std::pair<std::size_t, std::size_t> >,
+                      std::vector<double>, x_order, y_order>
+      (all_series, y_delay, duration, pairs, te_values);
+
+    const pt::ptime finished = pt::microsec_clock::universal_time();
+
+    std::ofstream out_file(out_file_path.c_str());
+    write_sparse_result_text(out_file, pairs, te_values);
+
+    if (opt_vars.count("screen-file")) {
+      std::ofstream screen_file(opt_vars["screen-file"].as<std::string>().c_str());
+      write_result_text(screen_file, screen_result, rows, cols);
+    }
+
+    const std::size_t screened_pairs = (std::size_t)(rows * cols);
+
+    std::cout << "Screened pairs:     " << screened_pairs << " (first order, "
+              << ((screened - start).total_microseconds() / 1e6) << " s)" << std::endl
+              << "Calculated pairs:   " << pairs.size() << " ("
+              << ((100.0 * pairs.size()) / std::max(screened_pairs, (std::size_t)1)) << "%, "
+              << ((finished - screened).total_microseconds() / 1e6) << " s)" << std::endl;
+
+    return (0);
+  }
+
   // Calculate TE
   ResultMatrix te_result(boost::extents[rows][cols]);
 
+#ifdef X_LAG_MASK
+  transent_ho_lags<TimeSeriesCollection, ResultMatrix, X_LAG_MASK, Y_LAG_MASK>
+    (all_series, duration, te_result,
+     row_start, rows, col_start, cols);
+#else
   transent_ho<TimeSeriesCollection, ResultMatrix, x_order, y_order>
     (all_series, y_delay, duration, te_result,
      row_start, rows, col_start, cols);
+#endif
 
   // Write results
   std::ofstream out_file(out_file_path.c_str());
@@ -0,0 +1,391 @@
+/*=============================================================================
+Copyright (c) 2011, The Trustees of Indiana University
+All rights reserved.
+
+Authors: Michael Hansen (mihansen@indiana.edu), Shinya Ito
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of Indiana University nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+=============================================================================*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <cstring>
+#include <cassert>
+
+#include <mpi.h>
+
+#include <boost/limits.hpp>
+#include <boost/multi_array.hpp>
+#include <boost/program_options.hpp>
+
+#include "transent.hpp"
+#include "spike_store.hpp"
+#include "te_io.hpp"
+
+// Typedefs
+typedef int TimeType;
+typedef SpikeStore<TimeType> Store;
+typedef SpikeStoreView<TimeType> StoreView;
+
+typedef boost::multi_array<double, 2> ResultMatrix;
+typedef ResultMatrix::index arr_index;
+
+// Largest element count passed to a single MPI call
+static const std::size_t MPI_CHUNK = 1 << 30;
+
+// Broadcasts a large buffer from rank 0 in pieces that fit into an int count
+void broadcast_bytes(void* data, std::size_t bytes, MPI_Comm comm) {
+  char* bytes_ptr = static_cast<char*>(data);
+
+  for (std::size_t done = 0; done < bytes; done += MPI_CHUNK) {
+    MPI_Bcast(bytes_ptr + done, (int)std::min(MPI_CHUNK, bytes - done),
+              MPI_BYTE, 0, comm);
+  }
+}
+
+// Splits rows [0, rows) into contiguous ranges of roughly equal estimated cost.
+// The counting loop visits every spike of the x series (x_order + 1) times and
+// every spike of the y series y_order times, plus a fixed setup per pair.
+void partition_rows(const StoreView& spikes,
+                    std::size_t x_order, std::size_t y_order,
+                    std::size_t row_start, std::size_t rows,
+                    std::size_t col_start, std::size_t cols,
+                    int num_ranks, std::vector<std::size_t>& row_bounds) {
+
+  const double pair_setup = 16;
+  double col_spikes = 0;
+
+  for (std::size_t j = col_start; j < (col_start + cols); ++j) {
+    col_spikes += spikes[j].size();
+  }
+
+  std::vector<double> cost_sum(rows + 1, 0);
+
+  for (std::size_t i = 0; i < rows; ++i) {
+    const double row_cost = (cols * ((x_order + 1) * (double)spikes[row_start + i].size() + pair_setup)) +
+                            (y_order * col_spikes);
+    cost_sum[i + 1] = cost_sum[i] + row_cost;
+  }
+
+  row_bounds.assign(num_ranks + 1, rows);
+  row_bounds[0] = 0;
+
+  for (int r = 1; r < num_ranks; ++r) {
+    const double target = cost_sum[rows] * r / num_ranks;
+    row_bounds[r] = std::lower_bound(cost_sum.begin(), cost_sum.end(), target) - cost_sum.begin();
+    row_bounds[r] = std::max(row_bounds[r], row_bounds[r - 1]);
+  }
+}
+
+int main(int argc, char *argv[]) {
+
+  MPI_Init(&argc, &argv);
+
+  int world_rank, world_size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+
+  namespace opt = boost::program_options;
+  opt::options_description desc("Calculates transfer entropy for a block of time series (y -> x) across MPI ranks");
+  desc.add_options()
+    ("help", "Show this help message")
+    ("x-order", opt::value<TimeType>()->default_value(1), "Order of predicted time series (default 1)")
+    ("y-order", opt::value<TimeType>()->default_value(1), "Order of predictor time series (default 1)")
+    ("y-delay", opt::value<TimeType>()->default_value(1), "Delay of predictor time series (default 1)")
+    ("in-file", opt::value<std::string>(), "Input time series file path")
+    ("out-file", opt::value<std::string>(), "Output transfer entropy file path")
+    ("out-format", opt::value<std::string>()->default_value("text"), "Output format: text (gathered on rank 0) or binary (written in parallel)")
+    ("precision", opt::value<std::string>()->default_value("float64"), "Binary value type: float64, float32, bfloat16, float16 or log-uint16 (default float64)")
+    ("col-start", opt::value<arr_index>()->default_value(0), "Column offset of block (default 0)")
+    ("cols", opt::value<arr_index>()->default_value(0), "Columns in block (default 0 for remainder)")
+    ("row-start", opt::value<arr_index>()->default_value(0), "Row offset of block (default 0)")
+    ("rows", opt::value<arr_index>()->default_value(0), "Rows in block (default 0 for remainder)")
+    ;
+
+  opt::variables_map opt_vars;
+  opt::store(opt::parse_command_line(argc, argv, desc), opt_vars);
+  opt::notify(opt_vars);
+
+  if (opt_vars.count("help")) {
+    if (world_rank == 0) {
+      std::cout << desc << std::endl;
+    }
+
+    MPI_Finalize();
+    return (0);
+  }
+
+  const std::size_t x_order = opt_vars["x-order"].as<TimeType>(),
+                    y_order = opt_vars["y-order"].as<TimeType>(),
+                    y_delay = opt_vars["y-delay"].as<TimeType>();
+
+  const std::size_t num_series = 1 + y_order + x_order;
+
+  assert(x_order > 0);
+  assert(y_order > 0);
+  assert(y_delay > 0);
+
+  if (num_series > MAX_XY_ORDER) {
+    if (world_rank == 0) {
+      std::cout << "The combined order of x and y cannot exceed " << MAX_XY_ORDER << std::endl;
+    }
+
+    MPI_Finalize();
+    return (0);
+  }
+
+  // Parse arguments
+  if (!opt_vars.count("in-file") || !opt_vars.count("out-file")) {
+    if (world_rank == 0) {
+      std::cout << "Input and output file paths are required" << std::endl;
+    }
+
+    MPI_Finalize();
+    return (0);
+  }
+
+  std::string in_file_path = opt_vars["in-file"].as<std::string>(),
+              out_file_path = opt_vars["out-file"].as<std::string>(),
+              out_format = opt_vars["out-format"].as<std::string>();
+
+  if ((out_format != "text") && (out_format != "binary")) {
+    if (world_rank == 0) {
+      std::cout << "Output format must be text or binary" << std::endl;
+    }
+
+    MPI_Finalize();
+    return (0);
+  }
+
+  ResultValueType precision;
+
+  if (!parse_result_precision(opt_vars["precision"].as<std::string>(), precision)) {
+    if (world_rank == 0) {
+      std::cout << "Precision must be float64, float32, bfloat16, float16 or log-uint16" << std::endl;
+    }
+
+    MPI_Finalize();
+    return (0);
+  }
+
+  arr_index col_start = opt_vars["col-start"].as<arr_index>(),
+            cols = opt_vars["cols"].as<arr_index>(),
+            row_start = opt_vars["row-start"].as<arr_index>(),
+            rows = opt_vars["rows"].as<arr_index>();
+
+  // Read in all time series on rank 0
+  Store root_store;
+  TimeType duration = 0;
+
+  // read ok, series count, spike store size, duration
+  unsigned long long info[4] = { 0, 0, 0, 0 };
+
+  if (world_rank == 0) {
+    if (read_time_series_file(in_file_path, root_store, duration)) {
+      info[0] = 1;
+      info[1] = root_store.size();
+      info[2] = root_store.times().size();
+      info[3] = duration;
+    }
+  }
+
+  MPI_Bcast(info, 4, MPI_UNSIGNED_LONG_LONG, 0, MPI_COMM_WORLD);
+
+  if (!info[0]) {
+    if (world_rank == 0) {
+      std::cout << "Unable to read input file " << in_file_path << std::endl;
+    }
+
+    MPI_Finalize();
+    return (0);
+  }
+
+  const std::size_t series_count = info[1],
+                    times_count = info[2];
+  duration = (TimeType)info[3];
+
+  // Blocks default to the remaining rows and columns, and must lie within the
+  // input
+  std::string block_error;
+
+  if (!resolve_block(in_file_path, series_count, row_start, rows, col_start, cols, block_error)) {
+    if (world_rank == 0) {
+      std::cout << block_error << std::endl;
+    }
+
+    MPI_Finalize();
+    return (0);
+  }
+
+  // Share the spike store once per node: the first rank on each node owns a
+  // shared memory segment, and the node leaders receive it from rank 0.
+  MPI_Comm node_comm, leader_comm;
+  int node_rank;
+
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, world_rank,
+                      MPI_INFO_NULL, &node_comm);
+  MPI_Comm_rank(node_comm, &node_rank);
+  MPI_Comm_split(MPI_COMM_WORLD, (node_rank == 0) ? 0 : MPI_UNDEFINED,
+                 world_rank, &leader_comm);
+
+  const std::size_t offsets_bytes = (series_count + 1) * sizeof(std::size_t),
+                    times_bytes = times_count * sizeof(TimeType);
+
+  MPI_Win store_win;
+  char* store_mem = 0;
+
+  MPI_Win_allocate_shared((node_rank == 0) ? (MPI_Aint)(offsets_bytes + times_bytes) : 0,
+                          1, MPI_INFO_NULL, node_comm, &store_mem, &store_win);
+
+  MPI_Aint segment_size;
+  int segment_disp;
+  MPI_Win_shared_query(store_win, 0, &segment_size, &segment_disp, &store_mem);
+
+  MPI_Win_fence(0, store_win);
+
+  if (node_rank == 0) {
+    if (world_rank == 0) {
+      std::memcpy(store_mem, root_store.offsets().data(), offsets_bytes);
+      std::memcpy(store_mem + offsets_bytes, root_store.times().data(), times_bytes);
+      root_store.clear();
+    }
+
+    broadcast_bytes(store_mem, offsets_bytes + times_bytes, leader_comm);
+    MPI_Comm_free(&leader_comm);
+  }
+
+  MPI_Win_fence(0, store_win);
+
+  const StoreView all_series(reinterpret_cast<const TimeType*>(store_mem + offsets_bytes),
+                             reinterpret_cast<const std::size_t*>(store_mem),
+                             series_count);
+
+  // Partition rows by estimated cost
+  std::vector<std::size_t> row_bounds;
+  partition_rows(all_series, x_order, y_order, row_start, rows, col_start, cols,
+                 world_size, row_bounds);
+
+  const std::size_t local_first = row_bounds[world_rank],
+                    local_rows = row_bounds[world_rank + 1] - local_first;
+
+  // Calculate TE
+  ResultMatrix te_result(boost::extents[local_rows][cols]);
+
+  if (local_rows > 0) {
+    transent_ho(all_series, x_order, y_order, y_delay, duration, te_result,
+                row_start + local_first, local_rows, col_start, cols);
+  }
+
+  // Write results
+  if (out_format == "binary") {
+    ResultHeader header;
+    header.set_parameters(x_order, y_order, y_delay, duration);
+    header.series_count = series_count;
+    header.row_start = row_start;
+    header.rows = rows;
+    header.col_start = col_start;
+    header.cols = cols;
+    header.value_type = precision;
+
+    // Log-quantised values are scaled by an upper bound of all TE values in
+    // the block, which every rank can work out from the spike counts
+    if (precision == RESULT_LOG_UINT16) {
+      header.scale = transent_upper_bound(all_series, x_order, y_order, y_delay, duration,
+                                          row_start, rows);
+    }
+
+    if (world_rank == 0) {
+      MPI_File_delete(const_cast<char*>(out_file_path.c_str()), MPI_INFO_NULL);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    MPI_File out_file;
+    MPI_File_open(MPI_COMM_WORLD, const_cast<char*>(out_file_path.c_str()),
+                  MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &out_file);
+
+    if (world_rank == 0) {
+      MPI_File_write_at(out_file, 0, &header, sizeof(ResultHeader), MPI_BYTE,
+                        MPI_STATUS_IGNORE);
+    }
+
+    // Each rank writes its own rows
+    const std::size_t local_count = local_rows * cols;
+    const MPI_Offset local_offset = header.row_offset(local_first);
+
+    // Compact value types are encoded into a separate buffer first
+    std::vector<char> local_bytes;
+    const char* local_data = reinterpret_cast<const char*>(te_result.data());
+    const std::size_t local_size = local_count * header.value_size();
+
+    if (precision != RESULT_FLOAT64) {
+      encode_result_values(header, te_result.data(), local_count, local_bytes);
+      local_data = local_bytes.data();
+    }
+
+    for (std::size_t done = 0; done < local_size; done += MPI_CHUNK) {
+      MPI_File_write_at(out_file, local_offset + done, const_cast<char*>(local_data) + done,
+                        (int)std::min(MPI_CHUNK, local_size - done), MPI_BYTE,
+                        MPI_STATUS_IGNORE);
+    }
+
+    MPI_File_close(&out_file);
+  }
+  else {
+    // Gathered in units of whole rows, so counts stay small for large blocks
+    MPI_Datatype row_type;
+    MPI_Type_contiguous((int)cols, MPI_DOUBLE, &row_type);
+    MPI_Type_commit(&row_type);
+
+    std::vector<int> recv_counts(world_size), recv_displs(world_size);
+
+    for (int r = 0; r < world_size; ++r) {
+      recv_counts[r] = (int)(row_bounds[r + 1] - row_bounds[r]);
+      recv_displs[r] = (int)row_bounds[r];
+    }
+
+    ResultMatrix full_result(boost::extents[(world_rank == 0) ? rows : 0][cols]);
+
+    MPI_Gatherv(te_result.data(), recv_counts[world_rank], row_type,
+                full_result.data(), recv_counts.data(), recv_displs.data(), row_type,
+                0, MPI_COMM_WORLD);
+
+    MPI_Type_free(&row_type);
+
+    if (world_rank == 0) {
+      std::ofstream out_file(out_file_path.c_str());
+      write_result_text(out_file, full_result, rows, cols);
+    }
+  }
+
+  MPI_Win_free(&store_win);
+  MPI_Comm_free(&node_comm);
+  MPI_Finalize();
+
+  return (0);
+}
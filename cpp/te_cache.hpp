@@ -0,0 +1,301 @@
+/*=============================================================================
+Copyright (c) 2011, The Trustees of Indiana University
+All rights reserved.
+
+Authors: Michael Hansen (mihansen@indiana.edu), Shinya Ito
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of Indiana University nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+=============================================================================*/
+
+
+#ifndef TE_CACHE_HPP
+#define TE_CACHE_HPP
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+#include <boost/cstdint.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/multi_array.hpp>
+
+#include "te_io.hpp"
+
+// =============================================================================
+// On-disk result cache
+//
+// Results are cached per tile in a directory of binary result files. A tile is
+// a piece of the transfer entropy matrix on a grid aligned to multiples of the
+// tile size, clipped to the requested block, and is stored under a file name
+// derived from a hash of the input time series, all parameters that affect
+// the result, and the tile's rows and columns. Blocks that share tiles with an
+// earlier run (the same block, or aligned blocks that overlap it) only compute
+// the missing ones.
+// =============================================================================
+
+// Bump this whenever a change to the transent functions changes results, so
+// stale cache entries are no longer found
+#define TE_CACHE_VERSION 2
+
+// Default tile size (rows and columns)
+#define TE_CACHE_TILE 256
+
+// Fast non-cryptographic 64-bit hash (MurmurHash3-style mixing of one 64-bit
+// word at a time). Good enough to tell datasets and parameter sets apart.
+class ResultHasher {
+
+public:
+  ResultHasher() : hash_(0x9e3779b97f4a7c15ULL), length_(0) { }
+
+  void add(const void* data, std::size_t bytes) {
+    const char* first = static_cast<const char*>(data);
+    boost::uint64_t word;
+
+    for (; bytes >= sizeof(word); bytes -= sizeof(word), first += sizeof(word)) {
+      std::memcpy(&word, first, sizeof(word));
+      mix(word);
+    }
+
+    if (bytes > 0) {
+      word = 0;
+      std::memcpy(&word, first, bytes);
+      mix(word);
+    }
+  }
+
+  template <typename T>
+  void add_value(T value) {
+    const boost::uint64_t word = (boost::uint64_t)value;
+    mix(word);
+  }
+
+  void add_string(const std::string& value) {
+    add_value(value.size());
+    add(value.data(), value.size());
+  }
+
+  // Adds every time series (length and times) of a collection
+  template <typename TimeSeriesCollection>
+  void add_series(const TimeSeriesCollection& all_series) {
+    typedef typename TimeSeriesCollection::value_type::value_type TimeType;
+
+    add_value(all_series.size());
+
+    for (std::size_t i = 0; i < all_series.size(); ++i) {
+      add_value(all_series[i].size());
+
+      if (!all_series[i].empty()) {
+        add(&(*all_series[i].begin()), all_series[i].size() * sizeof(TimeType));
+      }
+    }
+  }
+
+  boost::uint64_t digest() const {
+    boost::uint64_t h = hash_ ^ length_;
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return (h);
+  }
+
+private:
+  void mix(boost::uint64_t word) {
+    word *= 0x87c37b91114253d5ULL;
+    word = (word << 31) | (word >> 33);
+    word *= 0x4cf5ad432745937fULL;
+
+    hash_ ^= word;
+    hash_ = (hash_ << 27) | (hash_ >> 37);
+    hash_ = (hash_ * 5) + 0x52dce729;
+
+    length_ += sizeof(word);
+  }
+
+  boost::uint64_t hash_, length_;
+
+}; // ResultHasher
+
+// Piece of a block that is cached as a whole
+struct CacheTile {
+  std::size_t row_start, rows, col_start, cols;
+};
+
+// Splits a block into tiles on a grid aligned to multiples of tile_size
+inline void cache_tiles(std::size_t row_start, std::size_t rows,
+                        std::size_t col_start, std::size_t cols,
+                        std::size_t tile_size, std::vector<CacheTile>& tiles) {
+
+  tiles.clear();
+
+  for (std::size_t i = row_start; i < (row_start + rows); ) {
+    const std::size_t row_end = std::min(row_start + rows, ((i / tile_size) + 1) * tile_size);
+
+    for (std::size_t j = col_start; j < (col_start + cols); ) {
+      const std::size_t col_end = std::min(col_start + cols, ((j / tile_size) + 1) * tile_size);
+
+      CacheTile tile = { i, row_end - i, j, col_end - j };
+      tiles.push_back(tile);
+
+      j = col_end;
+    }
+
+    i = row_end;
+  }
+}
+
+// Directory of cached result tiles for one input and parameter set (key)
+class ResultCache {
+
+public:
+  typedef boost::multi_array<double, 2> TileMatrix;
+
+  // Creates dir if needed
+  ResultCache(const std::string& dir, boost::uint64_t key,
+              std::size_t series_count) :
+    dir_(dir), key_(key), series_count_(series_count) {
+    boost::system::error_code error;
+    boost::filesystem::create_directories(dir_, error);
+  }
+
+  std::string tile_path(const CacheTile& tile) const {
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << key_ << std::dec
+         << "-" << tile.row_start << "-" << tile.rows
+         << "-" << tile.col_start << "-" << tile.cols << ".tebm";
+
+    return ((boost::filesystem::path(dir_) / name.str()).string());
+  }
+
+  // Reads a cached tile into values (resized to rows x cols). Returns false if
+  // the tile is not cached or the file does not match it.
+  bool load(const CacheTile& tile, TileMatrix& values) const {
+    std::ifstream in_file(tile_path(tile).c_str(), std::ios::binary);
+    ResultHeader header;
+
+    if (!read_result_header(in_file, header) ||
+        (header.value_type != RESULT_FLOAT64) ||
+        (header.series_count != series_count_) ||
+        (header.row_start != tile.row_start) || (header.rows != tile.rows) ||
+        (header.col_start != tile.col_start) || (header.cols != tile.cols)) {
+      return (false);
+    }
+
+    values.resize(boost::extents[tile.rows][tile.cols]);
+    in_file.read(reinterpret_cast<char*>(values.data()),
+                 tile.rows * tile.cols * sizeof(double));
+
+    return (bool(in_file));
+  }
+
+  // Writes a tile to a temporary file and renames it into place, so
+  // concurrent jobs sharing the directory never see a partial tile. Returns
+  // false if the tile could not be written (the cache is then just skipped).
+  bool store(const CacheTile& tile, const TileMatrix& values) const {
+    const std::string path = tile_path(tile),
+                      temp_path = path + boost::filesystem::unique_path(".%%%%%%%%.tmp").string();
+
+    ResultHeader header;
+    header.series_count = series_count_;
+    header.row_start = tile.row_start;
+    header.rows = tile.rows;
+    header.col_start = tile.col_start;
+    header.cols = tile.cols;
+
+    {
+      std::ofstream out_file(temp_path.c_str(), std::ios::binary);
+      write_result_binary(out_file, values, header);
+
+      if (!out_file.flush()) {
+        std::remove(temp_path.c_str());
+        return (false);
+      }
+    }
+
+    boost::system::error_code error;
+    boost::filesystem::rename(temp_path, path, error);
+
+    if (error) {
+      std::remove(temp_path.c_str());
+      return (false);
+    }
+
+    return (true);
+  }
+
+private:
+  std::string dir_;
+  boost::uint64_t key_;
+  std::size_t series_count_;
+
+}; // ResultCache
+
+// Fills te_result with the (rows)x(cols) block at (row_start, col_start),
+// reading cached tiles and calling calculate(tile_result, tile_row_start,
+// tile_rows, tile_col_start, tile_cols) for the others, which are then added
+// to the cache. Returns the number of tiles calculated.
+template <typename ResultMatrix, typename Calculate>
+std::size_t transent_cached(const ResultCache& cache, std::size_t tile_size,
+                            ResultMatrix& te_result,
+                            std::size_t row_start, std::size_t rows,
+                            std::size_t col_start, std::size_t cols,
+                            Calculate calculate) {
+
+  std::vector<CacheTile> tiles;
+  cache_tiles(row_start, rows, col_start, cols, tile_size, tiles);
+
+  ResultCache::TileMatrix values;
+  std::size_t calculated = 0;
+
+  for (std::size_t t = 0; t < tiles.size(); ++t) {
+    const CacheTile& tile = tiles[t];
+
+    if (!cache.load(tile, values)) {
+      values.resize(boost::extents[tile.rows][tile.cols]);
+      calculate(values, tile.row_start, tile.rows, tile.col_start, tile.cols);
+      cache.store(tile, values);
+      ++calculated;
+    }
+
+    for (std::size_t i = 0; i < tile.rows; ++i) {
+      for (std::size_t j = 0; j < tile.cols; ++j) {
+        te_result[tile.row_start - row_start + i][tile.col_start - col_start + j] = values[i][j];
+      }
+    }
+  }
+
+  return (calculated);
+}
+
+#endif // TE_CACHE_HPP
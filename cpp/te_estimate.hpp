@@ -0,0 +1,306 @@
+/*=============================================================================
+Copyright (c) 2011, The Trustees of Indiana University
+All rights reserved.
+
+Authors: Michael Hansen (mihansen@indiana.edu), Shinya Ito
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of Indiana University nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+=============================================================================*/
+
+
+#ifndef TE_ESTIMATE_HPP
+#define TE_ESTIMATE_HPP
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "transent.hpp"
+
+// =============================================================================
+// Cost and memory estimates
+//
+// A dry run only needs the number of spikes of every time series. The run
+// time of a pair of the run-time transent_ho is modelled in work units, and
+// the seconds per unit are measured by running transent_ho on synthetic time
+// series with the same orders and spike rate, so the estimate follows the
+// machine and the kernel it is run with.
+// =============================================================================
+
+// Minimum time spent measuring the kernel (seconds)
+#define ESTIMATE_CALIBRATION_SECONDS 0.2
+
+// Largest number of spikes per synthetic time series (longer ones are scaled
+// down in time, keeping their rate)
+#define ESTIMATE_CALIBRATION_SPIKES 20000
+
+// Average characters per value in the ASCII output
+#define ESTIMATE_TEXT_VALUE_BYTES 12
+
+// Work units of one pair that grow with its spikes: the counting loop visits
+// every x spike (x_order + 1) times and every y spike y_order times, and
+// checks all (1 + x_order + y_order) series per visit
+inline double transent_pair_units(std::size_t x_order, std::size_t y_order,
+                                  double x_spikes, double y_spikes) {
+  return ((1 + x_order + y_order) * (((x_order + 1) * x_spikes) + (y_order * y_spikes)));
+}
+
+// Measured cost of the run-time transent_ho: seconds per pair (setting up the
+// iterators, clearing and scanning the count table) plus seconds per work unit
+struct TransentCostModel {
+  double seconds_per_pair, seconds_per_unit;
+
+  double seconds(double pairs, double units) const {
+    return ((pairs * seconds_per_pair) + (units * seconds_per_unit));
+  }
+};
+
+// Times transent_ho on synthetic time series of the given number of spikes
+// and duration for at least ESTIMATE_CALIBRATION_SECONDS / 2. Returns the
+// seconds, and adds the pairs and work units calculated.
+template <typename TimeType>
+double time_transent_ho(std::size_t x_order, std::size_t y_order, TimeType y_delay,
+                        TimeType duration, std::size_t spikes,
+                        double& pairs, double& units) {
+
+  typedef std::vector<TimeType> TimeSeries;
+  namespace pt = boost::posix_time;
+
+  const std::size_t series = 8;
+
+  // Uniformly spread times (a simple LCG keeps the estimate reproducible)
+  std::vector<TimeSeries> all_series(series);
+  boost::uint64_t state = 12345;
+
+  for (std::size_t i = 0; i < series; ++i) {
+    for (std::size_t k = 0; k < spikes; ++k) {
+      state = (state * 6364136223846793005ULL) + 1442695040888963407ULL;
+      all_series[i].push_back(1 + (TimeType)((state >> 33) % (boost::uint64_t)duration));
+    }
+
+    std::sort(all_series[i].begin(), all_series[i].end());
+    all_series[i].erase(std::unique(all_series[i].begin(), all_series[i].end()), all_series[i].end());
+  }
+
+  std::vector< std::vector<double> > te_row(1, std::vector<double>(series));
+  double seconds = 0;
+
+  const pt::ptime start = pt::microsec_clock::universal_time();
+
+  for (std::size_t i = 0; seconds < (ESTIMATE_CALIBRATION_SECONDS / 2); i = (i + 1) % series) {
+    transent_ho(all_series, x_order, y_order, y_delay, duration, te_row, i, 1, 0, series);
+
+    for (std::size_t j = 0; j < series; ++j) {
+      units += transent_pair_units(x_order, y_order, all_series[i].size(), all_series[j].size());
+    }
+
+    pairs += series;
+    seconds = (pt::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+  }
+
+  return (seconds);
+}
+
+// Measures the cost model of the run-time transent_ho for time series with
+// the given number of spikes and duration: once with a single spike per
+// series (the per pair cost), and once at the given rate
+template <typename TimeType>
+TransentCostModel calibrate_transent_ho(std::size_t x_order, std::size_t y_order, TimeType y_delay,
+                                        TimeType duration, double spikes) {
+
+  const TimeType window = std::max((TimeType)(y_order + y_delay), (TimeType)(x_order + 1));
+
+  // Keep the rate, but not more than ESTIMATE_CALIBRATION_SPIKES spikes
+  const double scale = std::min(1.0, ESTIMATE_CALIBRATION_SPIKES / std::max(spikes, 1.0));
+  const TimeType cal_duration = std::max((TimeType)(window + 2), (TimeType)(duration * scale));
+  const std::size_t cal_spikes = std::min((std::size_t)(cal_duration - 1),
+                                          std::max((std::size_t)1, (std::size_t)(spikes * scale)));
+
+  TransentCostModel model;
+  double pairs = 0, units = 0;
+
+  model.seconds_per_pair = time_transent_ho(x_order, y_order, y_delay, cal_duration, 1, pairs, units) / pairs;
+
+  pairs = units = 0;
+  const double seconds = time_transent_ho(x_order, y_order, y_delay, cal_duration, cal_spikes, pairs, units);
+
+  model.seconds_per_unit = std::max(0.0, seconds - (pairs * model.seconds_per_pair)) / units;
+
+  return (model);
+}
+
+// Estimated cost of a (rows)x(cols) block
+struct TransentEstimate {
+  std::size_t series_count, rows, cols, code_bits;
+  double spikes, count_table_bytes, spike_bytes, result_bytes, peak_bytes,
+         input_bytes, output_bytes, units, seconds;
+  TransentCostModel model;
+};
+
+// Work units of every row of a block
+inline void transent_row_units(const std::vector<std::size_t>& spike_counts,
+                               std::size_t x_order, std::size_t y_order,
+                               std::size_t row_start, std::size_t rows,
+                               std::size_t col_start, std::size_t cols,
+                               std::vector<double>& row_units) {
+
+  double col_spikes = 0;
+
+  for (std::size_t j = col_start; j < (col_start + cols); ++j) {
+    col_spikes += spike_counts[j];
+  }
+
+  // Linear in the spikes, so a row's columns can be summed at once
+  const double y_units = transent_pair_units(x_order, y_order, 0, 1);
+
+  row_units.resize(rows);
+
+  for (std::size_t i = 0; i < rows; ++i) {
+    row_units[i] = (cols * transent_pair_units(x_order, y_order, spike_counts[row_start + i], 0)) +
+                   (y_units * col_spikes);
+  }
+}
+
+// Estimates memory, output size and run time (on threads cores) of a block
+// calculated by te_block, from the spike counts. value_size is the size of a
+// stored result value.
+template <typename TimeType>
+TransentEstimate transent_estimate(const std::vector<std::size_t>& spike_counts,
+                                   std::size_t x_order, std::size_t y_order,
+                                   TimeType y_delay, TimeType duration,
+                                   std::size_t row_start, std::size_t rows,
+                                   std::size_t col_start, std::size_t cols,
+                                   std::size_t value_size, bool binary_output,
+                                   std::size_t threads) {
+
+  TransentEstimate estimate;
+
+  estimate.series_count = spike_counts.size();
+  estimate.rows = rows;
+  estimate.cols = cols;
+  estimate.code_bits = 1 + x_order + y_order;
+  estimate.spikes = 0;
+
+  for (std::size_t i = 0; i < spike_counts.size(); ++i) {
+    estimate.spikes += spike_counts[i];
+  }
+
+  // One count per code, times as std::vector<TimeType> series
+  estimate.count_table_bytes = std::pow(2.0, (double)estimate.code_bits) * sizeof(TimeType);
+  estimate.spike_bytes = (estimate.spikes * sizeof(TimeType)) +
+                         (estimate.series_count * (sizeof(std::vector<TimeType>) + 16));
+  estimate.result_bytes = (double)rows * cols * value_size;
+  estimate.peak_bytes = estimate.count_table_bytes + estimate.spike_bytes + estimate.result_bytes;
+
+  estimate.input_bytes = 0;
+  estimate.output_bytes = binary_output ? (56 + estimate.result_bytes) :
+                                          ((double)rows * cols * ESTIMATE_TEXT_VALUE_BYTES);
+
+  std::vector<double> row_units;
+  transent_row_units(spike_counts, x_order, y_order, row_start, rows, col_start, cols, row_units);
+
+  estimate.units = 0;
+  for (std::size_t i = 0; i < rows; ++i) {
+    estimate.units += row_units[i];
+  }
+
+  // Calibrate with the median spike count of the block's time series
+  std::vector<std::size_t> block_counts(spike_counts.begin() + row_start,
+                                        spike_counts.begin() + row_start + rows);
+  block_counts.insert(block_counts.end(), spike_counts.begin() + col_start,
+                      spike_counts.begin() + col_start + cols);
+  std::nth_element(block_counts.begin(), block_counts.begin() + (block_counts.size() / 2), block_counts.end());
+
+  estimate.model = calibrate_transent_ho(x_order, y_order, y_delay, duration,
+    block_counts.empty() ? 0.0 : (double)block_counts[block_counts.size() / 2]);
+  estimate.seconds = estimate.model.seconds((double)rows * cols, estimate.units) /
+                     std::max(threads, (std::size_t)1);
+
+  return (estimate);
+}
+
+// Splits the block rows into contiguous jobs that each take at most
+// max_seconds (on threads cores) and max_bytes of memory (0 for no limit).
+// row_bounds receives the first row of every job and the end of the block.
+// Returns false if a single row exceeds a budget (it then gets its own job).
+inline bool transent_split_rows(const std::vector<double>& row_units, std::size_t cols,
+                                const TransentCostModel& model, std::size_t threads,
+                                double fixed_bytes, double row_bytes,
+                                double max_seconds, double max_bytes,
+                                std::size_t row_start,
+                                std::vector<std::size_t>& row_bounds) {
+
+  bool fits = true;
+
+  row_bounds.assign(1, row_start);
+
+  double job_seconds = 0, job_bytes = fixed_bytes;
+
+  for (std::size_t i = 0; i < row_units.size(); ++i) {
+    const double seconds = model.seconds(cols, row_units[i]) / std::max(threads, (std::size_t)1);
+    const bool first_row = (row_bounds.back() == row_start + i);
+
+    if (!first_row && (((max_seconds > 0) && (job_seconds + seconds > max_seconds)) ||
+                       ((max_bytes > 0) && (job_bytes + row_bytes > max_bytes)))) {
+      row_bounds.push_back(row_start + i);
+      job_seconds = 0;
+      job_bytes = fixed_bytes;
+    }
+
+    job_seconds += seconds;
+    job_bytes += row_bytes;
+
+    fits = fits && !(((max_seconds > 0) && (job_seconds > max_seconds)) ||
+                     ((max_bytes > 0) && (job_bytes > max_bytes)));
+  }
+
+  row_bounds.push_back(row_start + row_units.size());
+  return (fits);
+}
+
+// Writes an estimate in a human readable form
+inline void write_estimate(std::ostream& out, const TransentEstimate& estimate) {
+  const double mb = 1024.0 * 1024.0;
+
+  out << "Time series:        " << estimate.series_count << " (" << estimate.spikes << " spikes)" << std::endl
+      << "Block:              " << estimate.rows << " x " << estimate.cols << std::endl
+      << "Count table:        2^" << estimate.code_bits << " codes, "
+      << (estimate.count_table_bytes / mb) << " MB" << std::endl
+      << "Time series memory: " << (estimate.spike_bytes / mb) << " MB" << std::endl
+      << "Result memory:      " << (estimate.result_bytes / mb) << " MB" << std::endl
+      << "Peak memory:        " << (estimate.peak_bytes / mb) << " MB" << std::endl
+      << "Input size:         " << (estimate.input_bytes / mb) << " MB" << std::endl
+      << "Output size:        " << (estimate.output_bytes / mb) << " MB" << std::endl
+      << "Kernel cost:        " << (estimate.model.seconds_per_pair * 1e9) << " ns per pair + "
+      << (estimate.model.seconds_per_unit * 1e9) << " ns per spike visit" << std::endl
+      << "Calculation time:   " << estimate.seconds << " s" << std::endl;
+}
+
+#endif // TE_ESTIMATE_HPP
@@ -0,0 +1,1095 @@
+/*=============================================================================
+Copyright (c) 2011, The Trustees of Indiana University
+All rights reserved.
+
+Authors: Michael Hansen (mihansen@indiana.edu), Shinya Ito
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of Indiana University nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+=============================================================================*/
+
+#ifndef TE_IO_HPP
+#define TE_IO_HPP
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <iterator>
+#include <cstring>
+#include <cmath>
+#include <cassert>
+#include <cctype>
+
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "transent.hpp"
+#include "spike_store.hpp"
+
+// Reads an ASCII time series file (duration on the first line, one series per
+// line after that) into a spike store. Returns false if the file could not be
+// opened or has no duration line.
+template <typename TimeType>
+bool read_time_series_file(const std::string& path,
+                           SpikeStore<TimeType>& store,
+                           TimeType& duration) {
+
+  std::ifstream in_file(path.c_str());
+  std::string line;
+
+  if (!getline(in_file, line)) {
+    return (false);
+  }
+
+  duration = boost::lexical_cast<TimeType>(line);
+  store.clear();
+
+  std::vector<TimeType> cur_series;
+
+  while (getline(in_file, line)) {
+
+    std::istringstream line_stream(line);
+    cur_series.clear();
+
+    std::copy(std::istream_iterator<TimeType>(line_stream),
+              std::istream_iterator<TimeType>(),
+              std::back_inserter(cur_series));
+
+    store.push_back(cur_series);
+  }
+
+  return (true);
+}
+
+// Reads only the duration and the number of spikes of every time series of an
+// ASCII time series file (times are counted, not parsed). Returns false if the
+// file could not be opened or has no duration line.
+template <typename TimeType>
+bool read_spike_counts(const std::string& path,
+                       TimeType& duration,
+                       std::vector<std::size_t>& spike_counts) {
+
+  std::ifstream in_file(path.c_str());
+  std::string line;
+
+  if (!getline(in_file, line)) {
+    return (false);
+  }
+
+  duration = boost::lexical_cast<TimeType>(line);
+  spike_counts.clear();
+
+  while (getline(in_file, line)) {
+    std::size_t count = 0;
+    bool in_time = false;
+
+    for (std::size_t c = 0; c < line.size(); ++c) {
+      const bool space = std::isspace((unsigned char)line[c]);
+      count += (!space && !in_time);
+      in_time = !space;
+    }
+
+    spike_counts.push_back(count);
+  }
+
+  return (true);
+}
+
+// Reads an ASCII time series file once and builds a coarsened spike store for
+// each bin factor (the same rebinning as ASDFChangeBinning: a time t becomes
+// ceil(t / factor), with duplicates removed). durations receives
+// ceil(duration / factor) for each factor. With keep_counts, duplicates are
+// kept so that each coarse bin repeats once per spike (for
+// transent_ho_symbols).
+template <typename TimeType>
+bool read_time_series_pyramid(const std::string& path,
+                              const std::vector<TimeType>& factors,
+                              std::vector< SpikeStore<TimeType> >& stores,
+                              std::vector<TimeType>& durations,
+                              bool keep_counts = false) {
+
+  std::ifstream in_file(path.c_str());
+  std::string line;
+
+  if (!getline(in_file, line)) {
+    return (false);
+  }
+
+  const TimeType duration = boost::lexical_cast<TimeType>(line);
+  const std::size_t num_factors = factors.size();
+
+  stores.assign(num_factors, SpikeStore<TimeType>());
+  durations.resize(num_factors);
+
+  for (std::size_t f = 0; f < num_factors; ++f) {
+    assert(factors[f] > 0);
+    durations[f] = (duration + factors[f] - 1) / factors[f];
+  }
+
+  std::vector< std::vector<TimeType> > cur_series(num_factors);
+  TimeType time, coarse_time;
+
+  while (getline(in_file, line)) {
+
+    std::istringstream line_stream(line);
+
+    for (std::size_t f = 0; f < num_factors; ++f) {
+      cur_series[f].clear();
+    }
+
+    // Rebin every spike for all factors as it is read
+    while (line_stream >> time) {
+      for (std::size_t f = 0; f < num_factors; ++f) {
+        coarse_time = (time + factors[f] - 1) / factors[f];
+
+        if (keep_counts || cur_series[f].empty() || (cur_series[f].back() != coarse_time)) {
+          cur_series[f].push_back(coarse_time);
+        }
+      }
+    }
+
+    for (std::size_t f = 0; f < num_factors; ++f) {
+      stores[f].push_back(cur_series[f]);
+    }
+  }
+
+  return (true);
+}
+
+// Parses a comma-separated lag list (e.g. "1,3,10,30"). An empty list gives
+// the contiguous lags first .. first + order - 1. Returns false if a lag is
+// not a positive integer.
+inline bool parse_lag_list(const std::string& list,
+                           std::size_t order, std::size_t first,
+                           std::vector<std::size_t>& lags) {
+  lags.clear();
+
+  if (list.empty()) {
+    for (std::size_t k = 0; k < order; ++k) {
+      lags.push_back(first + k);
+    }
+
+    return (true);
+  }
+
+  std::istringstream list_stream(list);
+  std::string lag;
+
+  while (getline(list_stream, lag, ',')) {
+    try {
+      lags.push_back(boost::lexical_cast<std::size_t>(lag));
+    }
+    catch (const boost::bad_lexical_cast&) {
+      return (false);
+    }
+
+    if (lags.back() == 0) {
+      return (false);
+    }
+  }
+
+  return (!lags.empty());
+}
+
+// Reads a pair list file: one "predicted predictor" pair of 0-based time
+// series indices per line. Returns false if the file could not be read or an
+// index is not below series_count.
+inline bool read_pair_list(const std::string& path, std::size_t series_count,
+                           std::vector< std::pair<std::size_t, std::size_t> >& pairs) {
+
+  std::ifstream in_file(path.c_str());
+  std::size_t i, j;
+
+  if (!in_file) {
+    return (false);
+  }
+
+  pairs.clear();
+
+  while (in_file >> i >> j) {
+    if ((i >= series_count) || (j >= series_count)) {
+      return (false);
+    }
+
+    pairs.push_back(std::make_pair(i, j));
+  }
+
+  return (in_file.eof());
+}
+
+// Reads a whitespace-separated list of 0-based time series indices.
+inline bool read_index_list(const std::string& path,
+                            std::vector<std::size_t>& indices) {
+
+  std::ifstream in_file(path.c_str());
+
+  if (!in_file) {
+    return (false);
+  }
+
+  indices.assign(std::istream_iterator<std::size_t>(in_file),
+                 std::istream_iterator<std::size_t>());
+
+  return (true);
+}
+
+// Reads a time series diff file for transent_ho_update and fills
+// previous_index (see there) for series_count new time series. Each line is
+// "added", "removed" or "changed" followed by 0-based time series indices.
+// Removed indices refer to the previous time series, added and changed ones to
+// the new ones. All other new time series are the remaining previous ones in
+// the same order. Returns false if the file could not be read or does not fit
+// the time series counts.
+inline bool read_series_diff(const std::string& path,
+                             std::size_t previous_count,
+                             std::size_t series_count,
+                             std::vector<std::size_t>& previous_index) {
+
+  std::ifstream in_file(path.c_str());
+  std::string line, kind;
+  std::size_t index;
+
+  if (!in_file) {
+    return (false);
+  }
+
+  std::vector<bool> removed(previous_count, false), added(series_count, false),
+                    changed(series_count, false);
+
+  while (getline(in_file, line)) {
+    std::istringstream line_stream(line);
+
+    if (!(line_stream >> kind)) {
+      continue;
+    }
+
+    while (line_stream >> index) {
+      if (kind == "removed") {
+        if (index >= previous_count) {
+          return (false);
+        }
+
+        removed[index] = true;
+      }
+      else if ((kind == "added") || (kind == "changed")) {
+        if (index >= series_count) {
+          return (false);
+        }
+
+        ((kind == "added") ? added : changed)[index] = true;
+      }
+      else {
+        return (false);
+      }
+    }
+  }
+
+  // Match the remaining time series in order
+  previous_index.assign(series_count, TRANSENT_NO_PREVIOUS);
+  std::size_t previous = 0;
+
+  for (std::size_t i = 0; i < series_count; ++i) {
+    if (added[i]) {
+      continue;
+    }
+
+    while ((previous < previous_count) && removed[previous]) {
+      ++previous;
+    }
+
+    if (previous == previous_count) {
+      return (false);
+    }
+
+    if (!changed[i]) {
+      previous_index[i] = previous;
+    }
+
+    ++previous;
+  }
+
+  while ((previous < previous_count) && removed[previous]) {
+    ++previous;
+  }
+
+  return (previous == previous_count);
+}
+
+// Writes sparse results, one "predicted predictor te" line per pair.
+template <typename PairCollection, typename ResultVector>
+void write_sparse_result_text(std::ostream& out,
+                              const PairCollection& pairs,
+                              const ResultVector& te_values) {
+
+  for (std::size_t p = 0; p < pairs.size(); ++p) {
+    out << pairs[p].first << " " << pairs[p].second << " " << te_values[p] << std::endl;
+  }
+}
+
+// Writes the local transfer entropy of every pair (see transent_local), one
+// line per pair: predicted and predictor index, the value of bins without
+// spikes, then a bin and its value for every other bin.
+template <typename PairCollection, typename LocalCollection>
+void write_local_result_text(std::ostream& out,
+                             const PairCollection& pairs,
+                             const LocalCollection& locals) {
+
+  for (std::size_t p = 0; p < pairs.size(); ++p) {
+    out << pairs[p].first << " " << pairs[p].second << " " << locals[p].zero_value;
+
+    for (std::size_t t = 0; t < locals[p].times.size(); ++t) {
+      out << " " << locals[p].times[t] << " " << locals[p].values[t];
+    }
+
+    out << std::endl;
+  }
+}
+
+// Writes the same records in native byte order, without a header: per pair
+// uint64 predicted and predictor index, uint64 number of bins with spikes n,
+// float64 value of bins without spikes, n bins (of the time type) and their
+// n float64 values.
+template <typename PairCollection, typename LocalCollection>
+void write_local_result_binary(std::ostream& out,
+                               const PairCollection& pairs,
+                               const LocalCollection& locals) {
+
+  for (std::size_t p = 0; p < pairs.size(); ++p) {
+    const boost::uint64_t fields[3] = { pairs[p].first, pairs[p].second, locals[p].times.size() };
+
+    out.write(reinterpret_cast<const char*>(fields), sizeof(fields));
+    out.write(reinterpret_cast<const char*>(&locals[p].zero_value), sizeof(double));
+    out.write(reinterpret_cast<const char*>(locals[p].times.data()),
+              locals[p].times.size() * sizeof(locals[p].times[0]));
+    out.write(reinterpret_cast<const char*>(locals[p].values.data()),
+              locals[p].values.size() * sizeof(double));
+  }
+}
+
+// Resolves the block requested on a te_block* command line: rows or cols of 0
+// become the rest of the series_count time series of path. Returns false and
+// describes the problem in error if the block does not lie within them.
+template <typename Index>
+bool resolve_block(const std::string& path, std::size_t series_count,
+                   Index row_start, Index& rows, Index col_start, Index& cols,
+                   std::string& error) {
+
+  if (rows == 0) {
+    rows = (Index)series_count - row_start;
+  }
+
+  if (cols == 0) {
+    cols = (Index)series_count - col_start;
+  }
+
+  if ((row_start < 0) || (col_start < 0) || (rows <= 0) || (cols <= 0) ||
+      ((row_start + rows) > (Index)series_count) ||
+      ((col_start + cols) > (Index)series_count)) {
+    error = "Block is outside the " + boost::lexical_cast<std::string>(series_count) +
+            " time series of " + path;
+    return (false);
+  }
+
+  return (true);
+}
+
+// Builds the pair list requested on a te_block* command line: either an
+// explicit pair file, or all combinations of the given predicted and
+// predictor index files (an empty path means all time series). Returns false
+// if a file could not be read or holds an index that is not below
+// series_count.
+inline bool read_sparse_selection(const std::string& pairs_path,
+                                  const std::string& row_ids_path,
+                                  const std::string& col_ids_path,
+                                  std::size_t series_count,
+                                  std::vector< std::pair<std::size_t, std::size_t> >& pairs) {
+
+  if (!pairs_path.empty()) {
+    return (read_pair_list(pairs_path, series_count, pairs));
+  }
+
+  std::vector<std::size_t> row_ids(series_count), col_ids(series_count);
+
+  for (std::size_t i = 0; i < series_count; ++i) {
+    row_ids[i] = col_ids[i] = i;
+  }
+
+  if (!row_ids_path.empty() && !read_index_list(row_ids_path, row_ids)) {
+    return (false);
+  }
+
+  if (!col_ids_path.empty() && !read_index_list(col_ids_path, col_ids)) {
+    return (false);
+  }
+
+  for (std::size_t i = 0; i < row_ids.size(); ++i) {
+    if (row_ids[i] >= series_count) {
+      return (false);
+    }
+  }
+
+  for (std::size_t j = 0; j < col_ids.size(); ++j) {
+    if (col_ids[j] >= series_count) {
+      return (false);
+    }
+  }
+
+  transent_pairs_from_sets(row_ids, col_ids, pairs);
+  return (true);
+}
+
+// Writes a (rows)x(cols) result block in the ASCII output format. As with the
+// te_block programs, each output line holds one predictor (y) and each column
+// one predicted (x) time series.
+template <typename ResultMatrix>
+void write_result_text(std::ostream& out,
+                       const ResultMatrix& te_result,
+                       std::size_t rows, std::size_t cols) {
+
+  for (std::size_t j = 0; j < cols; ++j) {
+    for (std::size_t i = 0; i < rows; ++i) {
+      out << te_result[i][j] << " ";
+    }
+
+    out << std::endl;
+  }
+}
+
+// =============================================================================
+// Binary result format
+//
+// A fixed-size header followed by rows * cols values in row-major order, where
+// row i is predicted time series (row_start + i) and column j is predictor
+// time series (col_start + j). Unlike the ASCII format, the binary format is
+// not transposed.
+// =============================================================================
+
+enum ResultValueType {
+  RESULT_FLOAT64 = 0,
+  RESULT_FLOAT32 = 1,
+  RESULT_BFLOAT16 = 2,
+  RESULT_FLOAT16 = 3,
+  RESULT_LOG_UINT16 = 4
+};
+
+// Size of a version 1 header, which ends before x_order
+#define RESULT_HEADER_V1_SIZE 56
+
+struct ResultHeader {
+  char magic[4];
+  boost::uint32_t version;
+  boost::uint32_t value_type;
+  float scale;
+  boost::uint64_t series_count;
+  boost::uint64_t row_start, rows;
+  boost::uint64_t col_start, cols;
+
+  // Calculation of a plain transent_ho result (all zero if not recorded, as
+  // for other calculations and version 1 files)
+  boost::uint32_t x_order, y_order;
+  boost::uint64_t y_delay, duration;
+
+  ResultHeader() :
+    version(2), value_type(RESULT_FLOAT64), scale(0), series_count(0),
+    row_start(0), rows(0), col_start(0), cols(0),
+    x_order(0), y_order(0), y_delay(0), duration(0) {
+    std::memcpy(magic, "TEBM", 4);
+  }
+
+  bool valid() const {
+    return ((std::memcmp(magic, "TEBM", 4) == 0) && ((version == 1) || (version == 2)));
+  }
+
+  // Records the calculation of a plain transent_ho result
+  void set_parameters(std::size_t x, std::size_t y, boost::uint64_t delay,
+                      boost::uint64_t total_duration) {
+    x_order = x;
+    y_order = y;
+    y_delay = delay;
+    duration = total_duration;
+  }
+
+  bool has_parameters() const {
+    return (x_order > 0);
+  }
+
+  // Size in bytes of the header itself
+  std::size_t header_size() const {
+    return ((version == 1) ? RESULT_HEADER_V1_SIZE : sizeof(ResultHeader));
+  }
+
+  // Size in bytes of a single value
+  std::size_t value_size() const {
+    switch (value_type) {
+      case RESULT_FLOAT64: return (8);
+      case RESULT_FLOAT32: return (4);
+      default: return (2);
+    }
+  }
+
+  // Byte offset of the start of (block-relative) row i
+  boost::uint64_t row_offset(std::size_t i) const {
+    return (header_size() + (i * cols * value_size()));
+  }
+};
+
+// Reads a version 1 or 2 header (version 1 without the calculation fields)
+inline bool read_result_header(std::istream& in, ResultHeader& header) {
+  header = ResultHeader();
+  in.read(reinterpret_cast<char*>(&header), RESULT_HEADER_V1_SIZE);
+
+  if (in && header.valid() && (header.version > 1)) {
+    in.read(reinterpret_cast<char*>(&header) + RESULT_HEADER_V1_SIZE,
+            sizeof(ResultHeader) - RESULT_HEADER_V1_SIZE);
+  }
+
+  return (in && header.valid());
+}
+
+inline void write_result_header(std::ostream& out, const ResultHeader& header) {
+  out.write(reinterpret_cast<const char*>(&header), sizeof(ResultHeader));
+}
+
+// Writes a full result block (header included) in the binary format.
+template <typename ResultMatrix>
+void write_result_binary(std::ostream& out,
+                         const ResultMatrix& te_result,
+                         const ResultHeader& header) {
+
+  write_result_header(out, header);
+
+  std::vector<double> row_values(header.cols);
+
+  for (std::size_t i = 0; i < header.rows; ++i) {
+    for (std::size_t j = 0; j < header.cols; ++j) {
+      row_values[j] = te_result[i][j];
+    }
+
+    out.write(reinterpret_cast<const char*>(row_values.data()),
+              row_values.size() * sizeof(double));
+  }
+}
+
+// =============================================================================
+// Compact result values
+//
+// Codecs convert result values to and from a smaller stored type. Values
+// stored as bfloat16 keep 8 significant bits and float16 11 (with values
+// below 6e-5 losing precision and below 6e-8 becoming 0). Log-quantised
+// uint16 values cover RESULT_LOG_OCTAVES octaves below a per-matrix scale
+// with a relative error of at most 2^(1 / (2 * RESULT_LOG_STEPS)) - 1
+// (about 1.7e-4); smaller values are stored as 0.
+// =============================================================================
+
+// Steps per octave and octaves covered by log-quantised values
+#define RESULT_LOG_STEPS 2048
+#define RESULT_LOG_OCTAVES 32
+
+struct Float64Codec {
+  typedef double value_type;
+  static const ResultValueType type = RESULT_FLOAT64;
+
+  value_type encode(double value) const { return (value); }
+  double decode(value_type stored) const { return (stored); }
+  float scale() const { return (0); }
+};
+
+struct Float32Codec {
+  typedef float value_type;
+  static const ResultValueType type = RESULT_FLOAT32;
+
+  value_type encode(double value) const { return ((float)value); }
+  double decode(value_type stored) const { return (stored); }
+  float scale() const { return (0); }
+};
+
+// Upper half of a float32, rounded to nearest even
+struct BFloat16Codec {
+  typedef boost::uint16_t value_type;
+  static const ResultValueType type = RESULT_BFLOAT16;
+
+  value_type encode(double value) const {
+    const float single = (float)value;
+    boost::uint32_t bits;
+    std::memcpy(&bits, &single, sizeof(bits));
+
+    // NaN stays NaN
+    if ((bits & 0x7fffffffu) > 0x7f800000u) {
+      return ((value_type)((bits >> 16) | 0x40));
+    }
+
+    bits += 0x7fffu + ((bits >> 16) & 1);
+    return ((value_type)(bits >> 16));
+  }
+
+  double decode(value_type stored) const {
+    const boost::uint32_t bits = (boost::uint32_t)stored << 16;
+    float single;
+    std::memcpy(&single, &bits, sizeof(single));
+
+    return (single);
+  }
+
+  float scale() const { return (0); }
+};
+
+// IEEE 754 half precision, rounded to nearest even
+struct Float16Codec {
+  typedef boost::uint16_t value_type;
+  static const ResultValueType type = RESULT_FLOAT16;
+
+  value_type encode(double value) const {
+    const float single = (float)value;
+    boost::uint32_t bits;
+    std::memcpy(&bits, &single, sizeof(bits));
+
+    const boost::uint32_t sign = (bits >> 16) & 0x8000u,
+                          magnitude = bits & 0x7fffffffu;
+
+    // NaN and infinity (and overflow to infinity)
+    if (magnitude >= 0x47800000u) {
+      return ((value_type)(sign | ((magnitude > 0x7f800000u) ? 0x7e00u : 0x7c00u)));
+    }
+
+    // Subnormal or zero: round magnitude / 2^-24 to an integer
+    if (magnitude < 0x38800000u) {
+      float scaled;
+      std::memcpy(&scaled, &magnitude, sizeof(scaled));
+
+      return ((value_type)(sign | (boost::uint32_t)std::nearbyint(scaled * 16777216.0f)));
+    }
+
+    // Normal: rebias the exponent and round the mantissa to 10 bits
+    boost::uint32_t half = magnitude - 0x38000000u;
+    half += 0xfffu + ((half >> 13) & 1);
+
+    return ((value_type)(sign | (half >> 13)));
+  }
+
+  double decode(value_type stored) const {
+    const boost::uint32_t sign = (boost::uint32_t)(stored & 0x8000u) << 16,
+                          exponent = (stored >> 10) & 0x1fu,
+                          mantissa = stored & 0x3ffu;
+    boost::uint32_t bits;
+
+    if (exponent == 0) {
+      const float magnitude = mantissa / 16777216.0f;
+      return (sign ? -magnitude : magnitude);
+    }
+
+    if (exponent == 0x1f) {
+      bits = sign | 0x7f800000u | (mantissa << 13);
+    }
+    else {
+      bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+
+    float single;
+    std::memcpy(&single, &bits, sizeof(single));
+
+    return (single);
+  }
+
+  float scale() const { return (0); }
+};
+
+// 0 stores values <= 0 (and below the covered range), q > 0 stores
+// scale * 2^((q - 65535) / RESULT_LOG_STEPS). Values above scale are clamped.
+class LogUInt16Codec {
+
+public:
+  typedef boost::uint16_t value_type;
+  static const ResultValueType type = RESULT_LOG_UINT16;
+
+  explicit LogUInt16Codec(float scale = 1) : scale_(scale) { }
+
+  value_type encode(double value) const {
+    if (!(value > 0) || !(scale_ > 0)) {
+      return (0);
+    }
+
+    const double level = 65535.0 + std::log2(value / scale_) * RESULT_LOG_STEPS;
+
+    if (level < 0.5) {
+      return (0);
+    }
+
+    return ((value_type)std::min(65535.0, std::floor(level + 0.5)));
+  }
+
+  double decode(value_type stored) const {
+    return (stored ? (scale_ * std::exp2((stored - 65535.0) / RESULT_LOG_STEPS)) : 0.0);
+  }
+
+  float scale() const { return (scale_); }
+
+private:
+  float scale_;
+};
+
+// (rows)x(cols) result matrix stored row-major with a codec. Elements are
+// read and assigned as doubles, so it can be passed to the transent
+// functions as the ResultMatrix.
+template <typename Codec>
+class CompactResultMatrix {
+
+public:
+  typedef typename Codec::value_type value_type;
+
+  class Element {
+  public:
+    Element(value_type* stored, const Codec* codec) : stored_(stored), codec_(codec) { }
+
+    Element& operator=(double value) {
+      *stored_ = codec_->encode(value);
+      return (*this);
+    }
+
+    Element& operator=(const Element& other) {
+      return (*this = (double)other);
+    }
+
+    operator double() const {
+      return (codec_->decode(*stored_));
+    }
+
+  private:
+    value_type* stored_;
+    const Codec* codec_;
+  };
+
+  class Row {
+  public:
+    Row(value_type* first, const Codec* codec) : first_(first), codec_(codec) { }
+
+    Element operator[](std::size_t j) const {
+      return (Element(first_ + j, codec_));
+    }
+
+  private:
+    value_type* first_;
+    const Codec* codec_;
+  };
+
+  typedef Row reference;
+
+  CompactResultMatrix(std::size_t rows, std::size_t cols, const Codec& codec = Codec()) :
+    values_(rows * cols), cols_(cols), codec_(codec) { }
+
+  Row operator[](std::size_t i) {
+    return (Row(&values_[i * cols_], &codec_));
+  }
+
+  // Read access only (elements must not be assigned through it)
+  Row operator[](std::size_t i) const {
+    return (Row(const_cast<value_type*>(&values_[i * cols_]), &codec_));
+  }
+
+  const Codec& codec() const {
+    return (codec_);
+  }
+
+  const std::vector<value_type>& values() const {
+    return (values_);
+  }
+
+private:
+  std::vector<value_type> values_;
+  std::size_t cols_;
+  Codec codec_;
+};
+
+// Writes a compact result block (header included) in the binary format, with
+// the value type and scale of its codec
+template <typename Codec>
+void write_result_binary(std::ostream& out,
+                         const CompactResultMatrix<Codec>& te_result,
+                         const ResultHeader& block_header) {
+
+  ResultHeader header = block_header;
+  header.value_type = Codec::type;
+  header.scale = te_result.codec().scale();
+
+  write_result_header(out, header);
+  out.write(reinterpret_cast<const char*>(te_result.values().data()),
+            te_result.values().size() * sizeof(typename Codec::value_type));
+}
+
+// Looks up the value type named by a --precision argument (float64, float32,
+// bfloat16, float16 or log-uint16). Returns false if the name is unknown.
+inline bool parse_result_precision(const std::string& name, ResultValueType& type) {
+  const char* names[] = { "float64", "float32", "bfloat16", "float16", "log-uint16" };
+
+  for (std::size_t t = 0; t <= RESULT_LOG_UINT16; ++t) {
+    if (name == names[t]) {
+      type = (ResultValueType)t;
+      return (true);
+    }
+  }
+
+  return (false);
+}
+
+template <typename Codec>
+void encode_result_values(const Codec& codec, const double* values,
+                          std::size_t count, std::vector<char>& bytes) {
+
+  typedef typename Codec::value_type StoredType;
+
+  bytes.resize(count * sizeof(StoredType));
+
+  for (std::size_t k = 0; k < count; ++k) {
+    const StoredType stored = codec.encode(values[k]);
+    std::memcpy(&bytes[k * sizeof(StoredType)], &stored, sizeof(StoredType));
+  }
+}
+
+// Encodes result values with the value type (and scale) of a binary result
+// header, e.g. to write rows computed as doubles in a compact file
+inline void encode_result_values(const ResultHeader& header, const double* values,
+                                 std::size_t count, std::vector<char>& bytes) {
+
+  switch (header.value_type) {
+    case RESULT_FLOAT32: encode_result_values(Float32Codec(), values, count, bytes); break;
+    case RESULT_BFLOAT16: encode_result_values(BFloat16Codec(), values, count, bytes); break;
+    case RESULT_FLOAT16: encode_result_values(Float16Codec(), values, count, bytes); break;
+    case RESULT_LOG_UINT16: encode_result_values(LogUInt16Codec(header.scale), values, count, bytes); break;
+    default: encode_result_values(Float64Codec(), values, count, bytes); break;
+  }
+}
+
+// Reads a full result block (header included) in the binary format into
+// values (rows * cols values, row-major), decoding compact value types.
+// Returns false if the header is not valid or the file is too short.
+inline bool read_result_binary(std::istream& in,
+                               ResultHeader& header,
+                               std::vector<double>& values) {
+
+  if (!read_result_header(in, header) || (header.value_type > RESULT_LOG_UINT16)) {
+    return (false);
+  }
+
+  const std::size_t count = header.rows * header.cols;
+  values.resize(count);
+
+  if (header.value_type == RESULT_FLOAT64) {
+    in.read(reinterpret_cast<char*>(values.data()), count * sizeof(double));
+  }
+  else if (header.value_type == RESULT_FLOAT32) {
+    std::vector<float> stored(count);
+    in.read(reinterpret_cast<char*>(stored.data()), count * sizeof(float));
+    std::copy(stored.begin(), stored.end(), values.begin());
+  }
+  else {
+    std::vector<boost::uint16_t> stored(count);
+    in.read(reinterpret_cast<char*>(stored.data()), count * sizeof(boost::uint16_t));
+
+    for (std::size_t k = 0; k < count; ++k) {
+      switch (header.value_type) {
+        case RESULT_BFLOAT16: values[k] = BFloat16Codec().decode(stored[k]); break;
+        case RESULT_FLOAT16: values[k] = Float16Codec().decode(stored[k]); break;
+        default: values[k] = LogUInt16Codec(header.scale).decode(stored[k]); break;
+      }
+    }
+  }
+
+  return (bool(in));
+}
+
+// =============================================================================
+// Joint count tables
+//
+// A count table file holds the joint code counts of every pair of a block
+// (see transent_ho_count_tables): a 72-byte header, an index of
+// rows * cols + 1 uint64 byte offsets (relative to the end of the index), and
+// one record per pair in row-major order. A record is a varint number of
+// nonzero codes followed by a (code gap, count) varint pair for each, in
+// increasing code order, where the gap is the code minus one more than the
+// previous code (minus 0 for the first). Varints hold 7 bits per byte, least
+// significant first, with the high bit set on every byte but the last.
+// =============================================================================
+
+struct CountTableHeader {
+  char magic[4];
+  boost::uint32_t version;
+  boost::uint32_t x_order, y_order, y_delay, alphabet;
+  boost::uint64_t end_time;
+  boost::uint64_t series_count;
+  boost::uint64_t row_start, rows;
+  boost::uint64_t col_start, cols;
+
+  CountTableHeader() :
+    version(1), x_order(0), y_order(0), y_delay(0), alphabet(2), end_time(0),
+    series_count(0), row_start(0), rows(0), col_start(0), cols(0) {
+    std::memcpy(magic, "TECT", 4);
+  }
+
+  bool valid() const {
+    return ((std::memcmp(magic, "TECT", 4) == 0) && (version == 1));
+  }
+
+  // Byte offset of the first record
+  boost::uint64_t data_offset() const {
+    return (sizeof(CountTableHeader) + (((rows * cols) + 1) * sizeof(boost::uint64_t)));
+  }
+};
+
+inline void append_varint(std::string& bytes, boost::uint64_t value) {
+  while (value >= 0x80) {
+    bytes.push_back((char)((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+
+  bytes.push_back((char)value);
+}
+
+// Decodes a varint at iter, advancing it. Returns false if it runs past end.
+inline bool read_varint(const char*& iter, const char* end, boost::uint64_t& value) {
+  value = 0;
+
+  for (std::size_t shift = 0; (iter != end) && (shift < 64); shift += 7) {
+    const unsigned char byte = (unsigned char)*(iter++);
+    value |= (boost::uint64_t)(byte & 0x7F) << shift;
+
+    if (!(byte & 0x80)) {
+      return (true);
+    }
+  }
+
+  return (false);
+}
+
+// Writes the records of a count table file as pairs are passed to it (a sink
+// for transent_ho_count_tables). The index is written by close().
+class CountTableWriter {
+public:
+  CountTableWriter(const std::string& path, const CountTableHeader& header) :
+    out_(path.c_str(), std::ios::binary), header_(header), offset_(0) {
+
+    offsets_.reserve((header.rows * header.cols) + 1);
+    offsets_.push_back(0);
+
+    out_.write(reinterpret_cast<const char*>(&header_), sizeof(CountTableHeader));
+    out_.seekp(header_.data_offset());
+  }
+
+  template <typename CountTable, typename CodeList>
+  void operator()(std::size_t, std::size_t,
+                  const CountTable& counts, const CodeList& codes) {
+
+    record_.clear();
+    append_varint(record_, codes.size());
+
+    std::size_t next = 0;
+
+    for (std::size_t c = 0; c < codes.size(); ++c) {
+      append_varint(record_, codes[c] - next);
+      append_varint(record_, counts[codes[c]]);
+      next = codes[c] + 1;
+    }
+
+    out_.write(record_.data(), record_.size());
+    offset_ += record_.size();
+    offsets_.push_back(offset_);
+  }
+
+  // Writes the index. Returns false if a write failed.
+  bool close() {
+    out_.seekp(sizeof(CountTableHeader));
+    out_.write(reinterpret_cast<const char*>(offsets_.data()),
+               offsets_.size() * sizeof(boost::uint64_t));
+    out_.close();
+
+    return (!out_.fail());
+  }
+
+private:
+  std::ofstream out_;
+  CountTableHeader header_;
+  std::vector<boost::uint64_t> offsets_;
+  boost::uint64_t offset_;
+  std::string record_;
+};
+
+inline bool read_count_table_header(std::istream& in, CountTableHeader& header) {
+  in.seekg(0);
+  in.read(reinterpret_cast<char*>(&header), sizeof(CountTableHeader));
+  return (in && header.valid());
+}
+
+// Reads the nonzero (code, count) entries of block-relative pair (i, j)
+// from a count table file, seeking through the index.
+inline bool read_count_table(std::istream& in, const CountTableHeader& header,
+                             std::size_t i, std::size_t j,
+                             std::vector< std::pair<boost::uint64_t, boost::uint64_t> >& entries) {
+
+  boost::uint64_t offsets[2];
+
+  entries.clear();
+
+  if ((i >= header.rows) || (j >= header.cols)) {
+    return (false);
+  }
+
+  in.seekg(sizeof(CountTableHeader) + (((i * header.cols) + j) * sizeof(boost::uint64_t)));
+  in.read(reinterpret_cast<char*>(offsets), sizeof(offsets));
+
+  if (!in || (offsets[1] < offsets[0])) {
+    return (false);
+  }
+
+  std::vector<char> record(offsets[1] - offsets[0]);
+
+  in.seekg(header.data_offset() + offsets[0]);
+  in.read(record.data(), record.size());
+
+  if (!in) {
+    return (false);
+  }
+
+  const char* iter = record.data();
+  const char* const end = iter + record.size();
+  boost::uint64_t size, gap, count, next = 0;
+
+  if (!read_varint(iter, end, size)) {
+    return (false);
+  }
+
+  entries.reserve(size);
+
+  for (boost::uint64_t c = 0; c < size; ++c) {
+    if (!read_varint(iter, end, gap) || !read_varint(iter, end, count)) {
+      return (false);
+    }
+
+    entries.push_back(std::make_pair(next + gap, count));
+    next += gap + 1;
+  }
+
+  return (true);
+}
+
+#endif // TE_IO_HPP
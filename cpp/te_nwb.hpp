@@ -0,0 +1,244 @@
+/*=============================================================================
+Copyright (c) 2011, The Trustees of Indiana University
+All rights reserved.
+
+Authors: Michael Hansen (mihansen@indiana.edu), Shinya Ito
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of Indiana University nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+=============================================================================*/
+
+
+#ifndef TE_NWB_HPP
+#define TE_NWB_HPP
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/limits.hpp>
+
+#include <hdf5.h>
+
+#include "spike_store.hpp"
+
+// =============================================================================
+// NWB / HDF5 spike time input
+//
+// Reads the spike times of a units table (NWB: /units/spike_times, seconds,
+// all units concatenated, and /units/spike_times_index, the end offset of
+// every unit) straight into a spike store. Times are read in chunks, turned
+// into 1-based time bins and filtered by time window as they arrive, so only
+// one chunk of raw times is held in memory. Needs the HDF5 C library (built
+// with h5c++, see "make te_block_nwb").
+// =============================================================================
+
+// Spike times read per HDF5 call
+#define NWB_READ_CHUNK 65536
+
+// What to read and how to bin it. Unit and time selection follow
+// ASDFSubsample and ASDFChooseTime: units are 0-based rows of the units table
+// in output order (empty for all units), and only bins start_bin .. end_bin
+// (inclusive, 0 for the first or last bin with a spike) are kept, shifted so
+// that start_bin becomes bin 1.
+struct NwbReadOptions {
+  std::string times_path, index_path;
+  double bin_seconds;
+  std::vector<std::size_t> units;
+  boost::int64_t start_bin, end_bin;
+  bool keep_counts;   // keep repeated bins (several spikes per bin)
+  std::size_t chunk_spikes;
+
+  NwbReadOptions() :
+    times_path("/units/spike_times"), index_path("/units/spike_times_index"),
+    bin_seconds(0.001), start_bin(0), end_bin(0), keep_counts(false),
+    chunk_spikes(NWB_READ_CHUNK) { }
+};
+
+// Closes an HDF5 identifier when it goes out of scope
+class Hdf5Handle {
+public:
+  Hdf5Handle(hid_t id, herr_t (*close)(hid_t)) : id_(id), close_(close) { }
+
+  ~Hdf5Handle() {
+    if (id_ >= 0) {
+      close_(id_);
+    }
+  }
+
+  hid_t id() const { return (id_); }
+  bool valid() const { return (id_ >= 0); }
+
+private:
+  Hdf5Handle(const Hdf5Handle&);
+  Hdf5Handle& operator=(const Hdf5Handle&);
+
+  hid_t id_;
+  herr_t (*close_)(hid_t);
+};
+
+// Number of elements of a one-dimensional dataset, or -1
+inline boost::int64_t hdf5_dataset_size(hid_t dataset) {
+  Hdf5Handle space(H5Dget_space(dataset), H5Sclose);
+  hsize_t size = 0;
+
+  if (!space.valid() || (H5Sget_simple_extent_ndims(space.id()) != 1) ||
+      (H5Sget_simple_extent_dims(space.id(), &size, 0) < 0)) {
+    return (-1);
+  }
+
+  return ((boost::int64_t)size);
+}
+
+// 1-based time bin of a time in seconds. The small offset keeps times that
+// are meant to lie exactly on a bin edge (e.g. 0.003 s with 1 ms bins) in the
+// bin that starts there despite rounding.
+inline boost::int64_t nwb_time_bin(double seconds, double bin_seconds) {
+  return ((boost::int64_t)std::floor((seconds / bin_seconds) + 1e-9) + 1);
+}
+
+// Reads the selected units of an NWB (or any HDF5) file with the layout above
+// into store, one time series per unit. duration receives
+// end_bin - start_bin + 1, or the last bin with a spike if end_bin is 0.
+// Returns false and describes the problem in error if the file or datasets
+// cannot be read or a unit index is out of range.
+template <typename TimeType>
+bool read_nwb_spike_times(const std::string& path,
+                          const NwbReadOptions& options,
+                          SpikeStore<TimeType>& store,
+                          TimeType& duration,
+                          std::string& error) {
+
+  // Errors are reported through error instead of the HDF5 error stack
+  H5Eset_auto2(H5E_DEFAULT, 0, 0);
+
+  Hdf5Handle file(H5Fopen(path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT), H5Fclose);
+
+  if (!file.valid()) {
+    error = "unable to open " + path;
+    return (false);
+  }
+
+  Hdf5Handle times(H5Dopen2(file.id(), options.times_path.c_str(), H5P_DEFAULT), H5Dclose),
+             index(H5Dopen2(file.id(), options.index_path.c_str(), H5P_DEFAULT), H5Dclose);
+
+  const boost::int64_t time_count = times.valid() ? hdf5_dataset_size(times.id()) : -1,
+                       unit_count = index.valid() ? hdf5_dataset_size(index.id()) : -1;
+
+  if ((time_count < 0) || (unit_count < 0)) {
+    error = "unable to read " + options.times_path + " and " + options.index_path;
+    return (false);
+  }
+
+  // End offsets of all units (converted from the stored integer type)
+  std::vector<boost::uint64_t> ends(unit_count);
+
+  if ((unit_count > 0) &&
+      (H5Dread(index.id(), H5T_NATIVE_UINT64, H5S_ALL, H5S_ALL, H5P_DEFAULT, &ends[0]) < 0)) {
+    error = "unable to read " + options.index_path;
+    return (false);
+  }
+
+  std::vector<std::size_t> units(options.units);
+
+  if (units.empty()) {
+    for (std::size_t u = 0; u < (std::size_t)unit_count; ++u) {
+      units.push_back(u);
+    }
+  }
+
+  Hdf5Handle file_space(H5Dget_space(times.id()), H5Sclose);
+  std::vector<double> chunk(std::max(options.chunk_spikes, (std::size_t)1));
+  std::vector<TimeType> bins;
+
+  const boost::int64_t first_bin = std::max(options.start_bin, (boost::int64_t)1),
+                       last_bin = (options.end_bin > 0) ? options.end_bin
+                                                        : std::numeric_limits<boost::int64_t>::max();
+  boost::int64_t max_bin = 0;
+
+  store.clear();
+
+  for (std::size_t s = 0; s < units.size(); ++s) {
+    const std::size_t u = units[s];
+
+    if (u >= (std::size_t)unit_count) {
+      error = "unit " + boost::lexical_cast<std::string>(u) + " is not in the units table";
+      return (false);
+    }
+
+    const hsize_t first = (u == 0) ? 0 : ends[u - 1], last = ends[u];
+
+    if ((first > last) || (last > (hsize_t)time_count)) {
+      error = "invalid spike_times_index entry for unit " + boost::lexical_cast<std::string>(u);
+      return (false);
+    }
+
+    bins.clear();
+
+    for (hsize_t offset = first; offset < last; offset += chunk.size()) {
+      hsize_t count = std::min((hsize_t)chunk.size(), last - offset);
+      Hdf5Handle memory_space(H5Screate_simple(1, &count, 0), H5Sclose);
+
+      if ((H5Sselect_hyperslab(file_space.id(), H5S_SELECT_SET, &offset, 0, &count, 0) < 0) ||
+          (H5Dread(times.id(), H5T_NATIVE_DOUBLE, memory_space.id(), file_space.id(),
+                   H5P_DEFAULT, &chunk[0]) < 0)) {
+        error = "unable to read " + options.times_path;
+        return (false);
+      }
+
+      for (std::size_t k = 0; k < count; ++k) {
+        const boost::int64_t bin = nwb_time_bin(chunk[k], options.bin_seconds);
+
+        if ((bin >= first_bin) && (bin <= last_bin)) {
+          bins.push_back((TimeType)(bin - first_bin + 1));
+        }
+      }
+    }
+
+    // Units are normally sorted already
+    if (std::adjacent_find(bins.begin(), bins.end(), std::greater<TimeType>()) != bins.end()) {
+      std::sort(bins.begin(), bins.end());
+    }
+
+    if (!options.keep_counts) {
+      bins.erase(std::unique(bins.begin(), bins.end()), bins.end());
+    }
+
+    if (!bins.empty()) {
+      max_bin = std::max(max_bin, (boost::int64_t)bins.back());
+    }
+
+    store.push_back(bins);
+  }
+
+  duration = (options.end_bin > 0) ? (TimeType)(options.end_bin - first_bin + 1) : (TimeType)max_bin;
+  return (true);
+}
+
+#endif // TE_NWB_HPP
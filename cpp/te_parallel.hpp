@@ -0,0 +1,583 @@
+/*=============================================================================
+Copyright (c) 2011, The Trustees of Indiana University
+All rights reserved.
+
+Authors: Michael Hansen (mihansen@indiana.edu), Shinya Ito
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of Indiana University nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+=============================================================================*/
+
+
+#ifndef TE_PARALLEL_HPP
+#define TE_PARALLEL_HPP
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+#include <boost/atomic.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
+#ifdef __linux__
+  #include <sched.h>
+  #include <unistd.h>
+  #include <sys/syscall.h>
+#endif
+
+#include "transent.hpp"
+#include "spike_store.hpp"
+
+// =============================================================================
+// NUMA-aware parallel block calculation
+//
+// Worker threads are spread over the NUMA nodes and pinned to their CPUs. The
+// read-only spike data is either replicated once per node (each copy written
+// by a thread on that node, so the first-touch policy places it there),
+// interleaved page by page over all nodes, or left as it is. Rows are split
+// into small tiles that are handed out to the workers of one node first; a
+// worker only takes tiles of another node once its own are gone. Placement is
+// done without libnuma: the topology comes from sysfs and page locations from
+// the move_pages system call.
+// =============================================================================
+
+// Rows per scheduled tile
+#define PARALLEL_ROW_TILE 4
+
+// Pages of each spike data copy sampled for the placement statistics
+#define PARALLEL_PAGE_SAMPLES 1024
+
+enum NumaPlacement {
+  NUMA_OFF = 0,
+  NUMA_INTERLEAVE,
+  NUMA_REPLICATE
+};
+
+// Parses a sysfs list of CPUs or nodes ("0-3,8,10-11")
+inline void parse_cpu_list(const std::string& list, std::vector<int>& ids) {
+  std::istringstream list_stream(list);
+  std::string range;
+
+  ids.clear();
+
+  while (getline(list_stream, range, ',')) {
+    int first, last;
+    char dash;
+    std::istringstream range_stream(range);
+
+    if (!(range_stream >> first)) {
+      continue;
+    }
+
+    last = first;
+
+    if (range_stream >> dash >> last) {
+      assert(dash == '-');
+    }
+
+    for (int id = first; id <= last; ++id) {
+      ids.push_back(id);
+    }
+  }
+}
+
+// NUMA nodes with CPUs, read from sysfs (a single node holding all CPUs if
+// that is not available)
+class NumaTopology {
+
+public:
+  NumaTopology() {
+    std::ifstream online_file("/sys/devices/system/node/online");
+    std::string line;
+    std::vector<int> node_ids, cpus;
+
+    if (getline(online_file, line)) {
+      parse_cpu_list(line, node_ids);
+    }
+
+    for (std::size_t n = 0; n < node_ids.size(); ++n) {
+      std::ostringstream path;
+      path << "/sys/devices/system/node/node" << node_ids[n] << "/cpulist";
+
+      std::ifstream cpus_file(path.str().c_str());
+
+      if (getline(cpus_file, line)) {
+        parse_cpu_list(line, cpus);
+
+        // Memory-only nodes get no workers
+        if (!cpus.empty()) {
+          node_ids_.push_back(node_ids[n]);
+          node_cpus_.push_back(cpus);
+        }
+      }
+    }
+
+    if (node_ids_.empty()) {
+      const int cpu_count = std::max(1, (int)boost::thread::hardware_concurrency());
+
+      cpus.clear();
+      for (int cpu = 0; cpu < cpu_count; ++cpu) {
+        cpus.push_back(cpu);
+      }
+
+      node_ids_.push_back(0);
+      node_cpus_.push_back(cpus);
+    }
+  }
+
+  std::size_t nodes() const {
+    return (node_ids_.size());
+  }
+
+  // Operating system id of node n
+  int node_id(std::size_t n) const {
+    return (node_ids_[n]);
+  }
+
+  const std::vector<int>& cpus(std::size_t n) const {
+    return (node_cpus_[n]);
+  }
+
+  // Pins the calling thread to a CPU. Returns false if that is not possible.
+  static bool pin(int cpu) {
+#ifdef __linux__
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+
+    return (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) == 0);
+#else
+    return (false);
+#endif
+  }
+
+  // Looks up the node of each page (node id, or a negative value if unknown)
+  static void page_nodes(std::vector<void*>& pages, std::vector<int>& nodes) {
+    nodes.assign(pages.size(), -1);
+
+#if defined(__linux__) && defined(SYS_move_pages)
+    if (!pages.empty() &&
+        (syscall(SYS_move_pages, 0, (unsigned long)pages.size(), pages.data(),
+                 (const int*)0, nodes.data(), 0) != 0)) {
+      nodes.assign(pages.size(), -1);
+    }
+#endif
+  }
+
+private:
+  std::vector<int> node_ids_;
+  std::vector< std::vector<int> > node_cpus_;
+
+}; // NumaTopology
+
+// Statistics of one node for a parallel calculation
+struct NumaNodeStats {
+  std::size_t workers, tiles, stolen_tiles;
+
+  // Bytes of spike data scanned by the node's workers
+  double spike_bytes;
+
+  // Fraction of the sampled pages of the spike data read by the node's
+  // workers that are on another node (negative if unknown)
+  double remote_fraction;
+
+  NumaNodeStats() :
+    workers(0), tiles(0), stolen_tiles(0), spike_bytes(0), remote_fraction(-1) { }
+};
+
+// Writes a table of per-node statistics, with the spike bytes read from
+// other nodes estimated from the sampled page locations
+inline void write_numa_stats(std::ostream& out, const NumaTopology& topology,
+                             const std::vector<NumaNodeStats>& stats) {
+
+  out << "node workers tiles stolen spike_mb remote_pages remote_mb" << std::endl;
+
+  for (std::size_t n = 0; n < stats.size(); ++n) {
+    const NumaNodeStats& node = stats[n];
+
+    out << topology.node_id(n) << " " << node.workers << " " << node.tiles
+        << " " << node.stolen_tiles << " " << (node.spike_bytes / 1e6) << " ";
+
+    if (node.remote_fraction < 0) {
+      out << "? ?" << std::endl;
+    }
+    else {
+      out << node.remote_fraction << " "
+          << (node.spike_bytes * node.remote_fraction / 1e6) << std::endl;
+    }
+  }
+}
+
+// Computes blocks of the transfer entropy matrix on worker threads spread
+// over the NUMA nodes. The time series are copied into contiguous stores (one
+// per node, one interleaved over all nodes, or a single unplaced one) when the
+// object is built, so several blocks can be calculated with the same copies.
+template <typename TimeType>
+class TransentParallel {
+
+public:
+  template <typename TimeSeriesCollection>
+  TransentParallel(const TimeSeriesCollection& all_series,
+                   NumaPlacement placement, std::size_t threads) :
+    placement_(placement), threads_(std::max(threads, (std::size_t)1)),
+    stats_(topology_.nodes()) {
+
+    for (std::size_t i = 0; i < all_series.size(); ++i) {
+      source_.push_back(all_series[i]);
+    }
+
+    copies_.resize((placement_ == NUMA_REPLICATE) ? topology_.nodes() : 1);
+
+    if (placement_ == NUMA_OFF) {
+      copies_[0] = source_.view();
+    }
+    else {
+      times_.resize(copies_.size(), (TimeType*)0);
+
+      for (std::size_t c = 0; c < copies_.size(); ++c) {
+        times_[c] = new TimeType[source_.times().size()];
+        copies_[c] = SpikeStoreView<TimeType>(times_[c], source_.offsets().data(), source_.size());
+      }
+
+      // Each node writes (and so places) its own copy, or its share of the
+      // pages of the interleaved copy
+      boost::thread_group copiers;
+
+      for (std::size_t n = 0; n < topology_.nodes(); ++n) {
+        copiers.create_thread(boost::bind(&TransentParallel::place, this, n));
+      }
+
+      copiers.join_all();
+    }
+
+    sample_placement();
+
+    // Only the offsets and spike counts of the source are still needed
+    if (placement_ != NUMA_OFF) {
+      std::vector<TimeType>().swap(source_.times());
+    }
+
+    for (std::size_t t = 0; t < threads_; ++t) {
+      ++stats_[worker_node(t)].workers;
+    }
+  }
+
+  ~TransentParallel() {
+    for (std::size_t c = 0; c < times_.size(); ++c) {
+      delete[] times_[c];
+    }
+  }
+
+  // Calculates the (rows)x(cols) block at (row_start, col_start) into
+  // te_result (indexed relative to the block, as in transent_ho)
+  template <typename ResultMatrix>
+  void transent_ho(std::size_t x_order, std::size_t y_order,
+                   TimeType y_delay, TimeType duration,
+                   ResultMatrix& te_result,
+                   std::size_t row_start, std::size_t rows,
+                   std::size_t col_start, std::size_t cols) {
+
+    const std::size_t tiles = (rows + PARALLEL_ROW_TILE - 1) / PARALLEL_ROW_TILE,
+                      nodes = topology_.nodes();
+
+    // Contiguous tile ranges per node
+    next_tile_.reset(new boost::atomic<std::size_t>[nodes]);
+    tile_end_.assign(nodes, 0);
+
+    for (std::size_t n = 0; n < nodes; ++n) {
+      next_tile_[n].store((tiles * n) / nodes);
+      tile_end_[n] = (tiles * (n + 1)) / nodes;
+    }
+
+    double col_spikes = 0;
+
+    for (std::size_t j = col_start; j < (col_start + cols); ++j) {
+      col_spikes += source_.spikes(j);
+    }
+
+    BlockTask<ResultMatrix> task = { &te_result, x_order, y_order, y_delay, duration,
+                                     row_start, rows, col_start, cols, col_spikes };
+
+    boost::thread_group workers;
+
+    for (std::size_t t = 0; t < threads_; ++t) {
+      workers.create_thread(boost::bind(&TransentParallel::work<ResultMatrix>,
+                                        this, t, boost::cref(task)));
+    }
+
+    workers.join_all();
+  }
+
+  const NumaTopology& topology() const {
+    return (topology_);
+  }
+
+  // Statistics over all blocks calculated so far
+  const std::vector<NumaNodeStats>& stats() const {
+    return (stats_);
+  }
+
+private:
+  template <typename ResultMatrix>
+  struct BlockTask {
+    ResultMatrix* te_result;
+    std::size_t x_order, y_order;
+    TimeType y_delay, duration;
+    std::size_t row_start, rows, col_start, cols;
+    double col_spikes;
+  };
+
+  // Rows of a result matrix shifted by a fixed offset, so transent_ho can
+  // fill a tile of a larger block
+  template <typename ResultMatrix>
+  struct ShiftedRows {
+    ResultMatrix* te_result;
+    std::size_t shift;
+
+    typename ResultMatrix::reference operator[](std::size_t i) const {
+      return ((*te_result)[i + shift]);
+    }
+  };
+
+  std::size_t worker_node(std::size_t t) const {
+    return (t % topology_.nodes());
+  }
+
+  const SpikeStoreView<TimeType>& node_copy(std::size_t n) const {
+    return (copies_[(placement_ == NUMA_REPLICATE) ? n : 0]);
+  }
+
+  // Copies node n's share of the spike data on a thread of node n
+  void place(std::size_t n) {
+    const std::vector<TimeType>& source = source_.times();
+    const std::size_t nodes = topology_.nodes();
+
+    NumaTopology::pin(topology_.cpus(n)[0]);
+
+    if (placement_ == NUMA_REPLICATE) {
+      std::copy(source.begin(), source.end(), times_[n]);
+      return;
+    }
+
+    // Interleaved: every nodes-th page
+    const std::size_t page = sysconf(_SC_PAGESIZE) / sizeof(TimeType);
+
+    for (std::size_t first = n * page; first < source.size(); first += nodes * page) {
+      const std::size_t last = std::min(first + page, source.size());
+      std::copy(source.begin() + first, source.begin() + last, times_[0] + first);
+    }
+  }
+
+  // Samples where the pages of each node's copy are
+  void sample_placement() {
+    const std::size_t page_bytes = sysconf(_SC_PAGESIZE),
+                      bytes = source_.offsets().back() * sizeof(TimeType),
+                      pages = (bytes + page_bytes - 1) / page_bytes,
+                      step = std::max((std::size_t)1, pages / PARALLEL_PAGE_SAMPLES);
+
+    for (std::size_t n = 0; n < topology_.nodes(); ++n) {
+      const char* first = reinterpret_cast<const char*>(
+        (placement_ == NUMA_OFF) ? source_.times().data() : times_[(placement_ == NUMA_REPLICATE) ? n : 0]);
+
+      std::vector<void*> addresses;
+      std::vector<int> nodes;
+
+      for (std::size_t p = 0; p < pages; p += step) {
+        addresses.push_back(const_cast<char*>(first + (p * page_bytes)));
+      }
+
+      NumaTopology::page_nodes(addresses, nodes);
+
+      std::size_t known = 0, remote = 0;
+
+      for (std::size_t p = 0; p < nodes.size(); ++p) {
+        if (nodes[p] >= 0) {
+          ++known;
+          remote += (nodes[p] != topology_.node_id(n));
+        }
+      }
+
+      stats_[n].remote_fraction = known ? ((double)remote / known) : -1;
+    }
+  }
+
+  template <typename ResultMatrix>
+  void work(std::size_t t, const BlockTask<ResultMatrix>& task) {
+
+    const std::size_t node = worker_node(t), nodes = topology_.nodes();
+    const std::vector<int>& cpus = topology_.cpus(node);
+
+    if (placement_ != NUMA_OFF) {
+      NumaTopology::pin(cpus[(t / nodes) % cpus.size()]);
+    }
+
+    const SpikeStoreView<TimeType>& spikes = node_copy(node);
+    ShiftedRows<ResultMatrix> tile_result = { task.te_result, 0 };
+
+    std::size_t tiles = 0, stolen_tiles = 0;
+    double spike_bytes = 0;
+
+    // Own tiles first, then the other nodes' tiles
+    for (std::size_t k = 0; k < nodes; ++k) {
+      const std::size_t from = (node + k) % nodes;
+
+      while (true) {
+        const std::size_t tile = next_tile_[from].fetch_add(1);
+
+        if (tile >= tile_end_[from]) {
+          break;
+        }
+
+        const std::size_t first_row = tile * PARALLEL_ROW_TILE,
+                          tile_rows = std::min(task.rows - first_row, (std::size_t)PARALLEL_ROW_TILE);
+
+        tile_result.shift = first_row;
+        ::transent_ho(spikes, task.x_order, task.y_order, task.y_delay, task.duration,
+                      tile_result, task.row_start + first_row, tile_rows,
+                      task.col_start, task.cols);
+
+        // Every x spike is visited (x_order + 1) times, every y spike y_order
+        // times
+        double row_spikes = 0;
+
+        for (std::size_t i = 0; i < tile_rows; ++i) {
+          row_spikes += source_.spikes(task.row_start + first_row + i);
+        }
+
+        spike_bytes += sizeof(TimeType) * ((task.x_order + 1) * row_spikes * task.cols +
+                                           task.y_order * task.col_spikes * tile_rows);
+        ++tiles;
+        stolen_tiles += (k > 0);
+      }
+    }
+
+    boost::lock_guard<boost::mutex> lock(stats_mutex_);
+    stats_[node].tiles += tiles;
+    stats_[node].stolen_tiles += stolen_tiles;
+    stats_[node].spike_bytes += spike_bytes;
+  }
+
+  NumaTopology topology_;
+  const NumaPlacement placement_;
+  const std::size_t threads_;
+
+  SpikeStore<TimeType> source_;
+  std::vector<TimeType*> times_;
+  std::vector< SpikeStoreView<TimeType> > copies_;
+
+  boost::scoped_array< boost::atomic<std::size_t> > next_tile_;
+  std::vector<std::size_t> tile_end_;
+
+  boost::mutex stats_mutex_;
+  std::vector<NumaNodeStats> stats_;
+
+}; // TransentParallel
+
+// =============================================================================
+// Local transfer entropy for a list of pairs
+// =============================================================================
+
+template <typename TimeSeriesCollection, typename PairCollection>
+struct LocalPairsTask {
+  typedef typename TimeSeriesCollection::value_type::value_type TimeType;
+
+  const TimeSeriesCollection* all_series;
+  const PairCollection* pairs;
+  std::size_t x_order, y_order;
+  TimeType y_delay, duration;
+  std::size_t alphabet;
+  std::vector< TransentLocalSeries<TimeType> >* results;
+  boost::atomic<std::size_t> next_pair;
+};
+
+// Takes the next pair until none are left
+template <typename TimeSeriesCollection, typename PairCollection>
+void transent_local_work(LocalPairsTask<TimeSeriesCollection, PairCollection>& task) {
+
+  while (true) {
+    const std::size_t p = task.next_pair.fetch_add(1);
+
+    if (p >= task.pairs->size()) {
+      break;
+    }
+
+    transent_local((*task.all_series)[(*task.pairs)[p].first],
+                   (*task.all_series)[(*task.pairs)[p].second],
+                   task.x_order, task.y_order, task.y_delay, task.duration,
+                   task.alphabet, (*task.results)[p]);
+  }
+}
+
+// Computes the local transfer entropy (see transent_local) of every
+// (predicted, predictor) pair of pairs into results[p], on threads worker
+// threads that each take the next pair when they are done with one.
+template <typename TimeSeriesCollection, typename PairCollection>
+void transent_local_pairs
+(const TimeSeriesCollection& all_series,
+ const std::size_t x_order, const std::size_t y_order,
+ const typename TimeSeriesCollection::value_type::value_type y_delay,
+ const typename TimeSeriesCollection::value_type::value_type duration,
+ const std::size_t alphabet,
+ const PairCollection& pairs,
+ std::vector< TransentLocalSeries<typename TimeSeriesCollection::value_type::value_type> >& results,
+ std::size_t threads) {
+
+  if (threads == 0) {
+    threads = boost::thread::hardware_concurrency();
+  }
+
+  results.resize(pairs.size());
+
+  LocalPairsTask<TimeSeriesCollection, PairCollection> task;
+  task.all_series = &all_series;
+  task.pairs = &pairs;
+  task.x_order = x_order;
+  task.y_order = y_order;
+  task.y_delay = y_delay;
+  task.duration = duration;
+  task.alphabet = alphabet;
+  task.results = &results;
+  task.next_pair.store(0);
+
+  boost::thread_group workers;
+
+  for (std::size_t t = 1; t < threads; ++t) {
+    workers.create_thread(boost::bind(&transent_local_work<TimeSeriesCollection, PairCollection>,
+                                      boost::ref(task)));
+  }
+
+  transent_local_work(task);
+  workers.join_all();
+
+} // transent_local_pairs
+
+#endif // TE_PARALLEL_HPP
@@ -0,0 +1,392 @@
+/*=============================================================================
+Copyright (c) 2011, The Trustees of Indiana University
+All rights reserved.
+
+Authors: Michael Hansen (mihansen@indiana.edu), Shinya Ito
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of Indiana University nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+=============================================================================*/
+
+
+#ifndef TE_PARSE_HPP
+#define TE_PARSE_HPP
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+#include <boost/bind/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/limits.hpp>
+#include <boost/thread/thread.hpp>
+
+#if __cplusplus >= 201703L
+  #include <charconv>
+#endif
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "spike_store.hpp"
+
+// =============================================================================
+// Parallel parsing of ASCII time series files
+//
+// The file is mapped into memory and split at line boundaries into one chunk
+// per thread. A first pass counts the lines and times of every chunk, which
+// gives each chunk its first time series and its place in the spike store;
+// the second pass parses the times straight into the pre-sized store and
+// checks that every time series is sorted. Both passes run on all threads.
+// =============================================================================
+
+// Read-only memory map of a whole file
+class MappedFile {
+public:
+  MappedFile() : data_(0), size_(0) { }
+
+  ~MappedFile() {
+    close();
+  }
+
+  // Returns false if the file could not be opened or mapped
+  bool open(const std::string& path) {
+    close();
+
+    const int fd = ::open(path.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+      return (false);
+    }
+
+    struct stat info;
+    bool ok = (fstat(fd, &info) == 0);
+
+    if (ok && (info.st_size > 0)) {
+      void* data = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      ok = (data != MAP_FAILED);
+
+      if (ok) {
+        data_ = static_cast<const char*>(data);
+        size_ = info.st_size;
+        madvise(data, size_, MADV_SEQUENTIAL);
+      }
+    }
+
+    ::close(fd);
+    return (ok);
+  }
+
+  void close() {
+    if (data_ != 0) {
+      munmap(const_cast<char*>(data_), size_);
+    }
+
+    data_ = 0;
+    size_ = 0;
+  }
+
+  const char* data() const { return (data_); }
+  std::size_t size() const { return (size_); }
+
+private:
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+
+  const char* data_;
+  std::size_t size_;
+};
+
+// Whitespace within a line (newlines end a time series)
+inline bool parse_is_blank(char c) {
+  return ((c == ' ') || (c == '\t') || (c == '\r') || (c == '\v') || (c == '\f'));
+}
+
+// Parses one time at first. Returns the end of the number, or first if there
+// is none.
+template <typename TimeType>
+const char* parse_time(const char* first, const char* last, TimeType& time) {
+#if __cplusplus >= 201703L
+  const std::from_chars_result result = std::from_chars(first, last, time);
+  return ((result.ec == std::errc()) ? result.ptr : first);
+#else
+  const char* c = first;
+  const bool negative = (c != last) && (*c == '-');
+  TimeType value = 0;
+
+  c += negative;
+
+  const char* digits = c;
+
+  for (; (c != last) && (*c >= '0') && (*c <= '9'); ++c) {
+    value = (value * 10) + (*c - '0');
+  }
+
+  if (c == digits) {
+    return (first);
+  }
+
+  time = negative ? -value : value;
+  return (c);
+#endif
+}
+
+// Lines and times of one chunk, and where its results go
+struct ParseChunk {
+  const char* first;
+  const char* last;
+  std::size_t lines, times;
+  std::size_t first_series, first_time;
+  std::size_t error_line;  // chunk-relative, or ~0 if none
+  const char* error;
+};
+
+// Number of bytes with the high bit set, for words with no other bits set
+inline std::size_t parse_count_high_bits(boost::uint64_t bits) {
+  return ((std::size_t)(((bits >> 7) * 0x0101010101010101ULL) >> 56));
+}
+
+// First pass: counts the lines (time series) and times of a chunk, eight
+// characters at a time. Characters above ' ' are time characters and a time
+// starts at every one that follows a blank, control character or newline;
+// other control characters are rejected by the second pass, so the counts
+// only have to be right for valid files.
+inline void parse_count_chunk(ParseChunk& chunk) {
+  const boost::uint64_t high = 0x8080808080808080ULL,
+                        low7 = 0x7f7f7f7f7f7f7f7fULL,
+                        spaces = 0x2121212121212121ULL,
+                        newlines = 0x0a0a0a0a0a0a0a0aULL;
+
+  const char* c = chunk.first;
+  std::size_t lines = 0, times = 0;
+  boost::uint64_t word, time_chars, previous = 0, line_ends;
+
+  for (; (chunk.last - c) >= 8; c += 8) {
+    std::memcpy(&word, c, 8);
+
+    // High bit of every byte above ' ', and of every newline byte
+    time_chars = (((word | high) - spaces) | word) & high;
+    line_ends = word ^ newlines;
+    line_ends = ~(((line_ends & low7) + low7) | line_ends) & high;
+
+    times += parse_count_high_bits(time_chars & ~((time_chars << 8) | (previous >> 56)));
+    lines += parse_count_high_bits(line_ends);
+    previous = time_chars;
+  }
+
+  bool in_time = (previous >> 63) != 0;
+
+  for (; c != chunk.last; ++c) {
+    const bool time_char = ((unsigned char)*c > ' ');
+
+    times += (time_char && !in_time);
+    lines += (*c == '\n');
+    in_time = time_char;
+  }
+
+  // Last line without a newline
+  if ((chunk.first != chunk.last) && (*(chunk.last - 1) != '\n')) {
+    ++lines;
+  }
+
+  chunk.lines = lines;
+  chunk.times = times;
+}
+
+// Second pass: parses a chunk into its part of the store. Every time series
+// is followed by the terminating element.
+template <typename TimeType>
+void parse_store_chunk(ParseChunk& chunk, TimeType* times, std::size_t* offsets) {
+  const TimeType terminator = std::numeric_limits<TimeType>::max();
+  const char* c = chunk.first;
+  std::size_t series = chunk.first_series, position = chunk.first_time + chunk.first_series;
+
+  for (std::size_t line = 0; line < chunk.lines; ++line) {
+    offsets[series] = position;
+
+    TimeType previous = std::numeric_limits<TimeType>::min(), time;
+
+    while ((c != chunk.last) && (*c != '\n')) {
+      if (parse_is_blank(*c)) {
+        ++c;
+        continue;
+      }
+
+      const char* end = parse_time(c, chunk.last, time);
+
+      if ((end == c) || ((end != chunk.last) && !parse_is_blank(*end) && (*end != '\n'))) {
+        chunk.error_line = line;
+        chunk.error = "invalid time";
+        return;
+      }
+
+      if (time < previous) {
+        chunk.error_line = line;
+        chunk.error = "times are not sorted";
+        return;
+      }
+
+      times[position++] = time;
+      previous = time;
+      c = end;
+    }
+
+    times[position++] = terminator;
+    ++series;
+
+    if (c != chunk.last) {
+      ++c;  // newline
+    }
+  }
+}
+
+// Reads an ASCII time series file into a spike store like
+// read_time_series_file, on threads threads (0 for all cores). Times must be
+// sorted within each line (repeated times are allowed). Returns false and
+// describes the problem, with its line number, in error if the file cannot be
+// read or is malformed.
+template <typename TimeType>
+bool read_time_series_mapped(const std::string& path,
+                             SpikeStore<TimeType>& store,
+                             TimeType& duration,
+                             std::string& error,
+                             std::size_t threads = 0) {
+
+  MappedFile file;
+
+  if (!file.open(path)) {
+    error = "unable to read " + path;
+    return (false);
+  }
+
+  const char* first = file.data();
+  const char* last = first + file.size();
+  const char* body = std::find(first, last, '\n');
+
+  // Duration line
+  const char* end = first;
+
+  while ((end != body) && parse_is_blank(*end)) {
+    ++end;
+  }
+
+  const char* number = end;
+  end = parse_time(number, body, duration);
+  bool valid = (end != number);
+
+  for (; valid && (end != body); ++end) {
+    valid = parse_is_blank(*end);
+  }
+
+  if (!valid) {
+    error = "line 1: invalid duration";
+    return (false);
+  }
+
+  body = std::min(body + 1, last);
+
+  // Chunks of whole lines
+  if (threads == 0) {
+    threads = boost::thread::hardware_concurrency();
+  }
+
+  threads = std::max((std::size_t)1, std::min(threads, (std::size_t)(last - body) / 4096 + 1));
+
+  std::vector<ParseChunk> chunks(threads);
+
+  for (std::size_t t = 0; t < threads; ++t) {
+    ParseChunk& chunk = chunks[t];
+
+    chunk.first = (t == 0) ? body : chunks[t - 1].last;
+    chunk.last = body + (((last - body) * (t + 1)) / threads);
+
+    if (chunk.last < chunk.first) {
+      chunk.last = chunk.first;
+    }
+    else if (chunk.last != last) {
+      chunk.last = std::min(std::find(chunk.last, last, '\n') + 1, last);
+    }
+
+    chunk.error_line = ~(std::size_t)0;
+    chunk.error = 0;
+  }
+
+  chunks.back().last = last;
+
+  boost::thread_group counters;
+
+  for (std::size_t t = 1; t < threads; ++t) {
+    counters.create_thread(boost::bind(&parse_count_chunk, boost::ref(chunks[t])));
+  }
+
+  parse_count_chunk(chunks[0]);
+  counters.join_all();
+
+  // Place every chunk in the store
+  std::size_t series = 0, times = 0;
+
+  for (std::size_t t = 0; t < threads; ++t) {
+    chunks[t].first_series = series;
+    chunks[t].first_time = times;
+    series += chunks[t].lines;
+    times += chunks[t].times;
+  }
+
+  store.clear();
+  store.times().resize(times + series);
+  store.offsets().resize(series + 1);
+  store.offsets()[series] = times + series;
+
+  TimeType* store_times = store.times().data();
+  std::size_t* store_offsets = store.offsets().data();
+
+  boost::thread_group parsers;
+
+  for (std::size_t t = 1; t < threads; ++t) {
+    parsers.create_thread(boost::bind(&parse_store_chunk<TimeType>, boost::ref(chunks[t]),
+                                      store_times, store_offsets));
+  }
+
+  parse_store_chunk(chunks[0], store_times, store_offsets);
+  parsers.join_all();
+
+  for (std::size_t t = 0; t < threads; ++t) {
+    if (chunks[t].error != 0) {
+      // Line 1 is the duration
+      error = "line " + boost::lexical_cast<std::string>(chunks[t].first_series + chunks[t].error_line + 2) +
+              ": " + chunks[t].error;
+      store.clear();
+      return (false);
+    }
+  }
+
+  return (true);
+}
+
+#endif // TE_PARSE_HPP
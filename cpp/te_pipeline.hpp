@@ -0,0 +1,601 @@
+/*=============================================================================
+Copyright (c) 2011, The Trustees of Indiana University
+All rights reserved.
+
+Authors: Michael Hansen (mihansen@indiana.edu), Shinya Ito
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of Indiana University nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+=============================================================================*/
+
+#ifndef TE_PIPELINE_HPP
+#define TE_PIPELINE_HPP
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <deque>
+
+#include <boost/bind/bind.hpp>
+#include <boost/limits.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/lockfree/queue.hpp>
+
+#include "transent.hpp"
+#include "te_io.hpp"
+
+// =============================================================================
+// Pipelined block calculation
+//
+// A reader thread parses the input file in chunks while worker threads compute
+// every pair whose two time series have already been read, and a writer thread
+// stores finished rows. Finished rows travel to the writer through a bounded
+// lock-free queue, so workers stall (instead of queueing without limit) when
+// the writer falls behind.
+// =============================================================================
+
+// Bytes read from the input file per chunk
+#define PIPELINE_CHUNK_SIZE (1 << 18)
+
+// Time series collection that one thread appends to while others read the
+// time series published so far. Series are stored in fixed-size blocks that
+// never move, so published series stay valid while more are added. As in a
+// SpikeStore, every series ends with std::numeric_limits<TimeType>::max(),
+// which transent_ho needs to stop counting (also for empty series).
+template <typename TimeType>
+class StreamingSeriesCollection {
+
+public:
+  typedef std::vector<TimeType> value_type;
+
+  StreamingSeriesCollection() :
+    blocks_(MAX_BLOCKS, (value_type*)0), size_(0), finished_(false),
+    duration_(0), appended_(0) { }
+
+  ~StreamingSeriesCollection() {
+    for (std::size_t b = 0; b < blocks_.size(); ++b) {
+      delete[] blocks_[b];
+    }
+  }
+
+  // Only valid for i < size()
+  const value_type& operator[](std::size_t i) const {
+    return (blocks_[i >> BLOCK_BITS][i & (BLOCK_SIZE - 1)]);
+  }
+
+  // Number of published time series
+  std::size_t size() const {
+    return (size_.load(boost::memory_order_acquire));
+  }
+
+  bool finished() const {
+    return (finished_.load(boost::memory_order_acquire));
+  }
+
+  // Only valid once the first series has been published or the input has
+  // finished
+  TimeType duration() const {
+    return (duration_);
+  }
+
+  // Blocks until more than count time series are published or the input has
+  // finished. Returns size().
+  std::size_t wait_for(std::size_t count) const {
+    boost::unique_lock<boost::mutex> lock(mutex_);
+
+    while ((size() <= count) && !finished()) {
+      published_.wait(lock);
+    }
+
+    return (size());
+  }
+
+  // Reader side: set before the first publish()
+  void set_duration(TimeType duration) {
+    duration_ = duration;
+  }
+
+  // Reader side: returns an empty series to fill, published by publish()
+  value_type& append() {
+    const std::size_t b = appended_ >> BLOCK_BITS;
+    assert(b < MAX_BLOCKS);
+
+    if (blocks_[b] == 0) {
+      blocks_[b] = new value_type[BLOCK_SIZE];
+    }
+
+    return (blocks_[b][appended_++ & (BLOCK_SIZE - 1)]);
+  }
+
+  // Reader side: makes all appended series visible to readers
+  void publish() {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    size_.store(appended_, boost::memory_order_release);
+    published_.notify_all();
+  }
+
+  // Reader side: publishes the remaining series and marks the input finished
+  void finish() {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    size_.store(appended_, boost::memory_order_release);
+    finished_.store(true, boost::memory_order_release);
+    published_.notify_all();
+  }
+
+private:
+  static const std::size_t BLOCK_BITS = 10,
+                           BLOCK_SIZE = (std::size_t)1 << BLOCK_BITS,
+                           MAX_BLOCKS = (std::size_t)1 << 16;
+
+  std::vector<value_type*> blocks_;
+  boost::atomic<std::size_t> size_;
+  boost::atomic<bool> finished_;
+  TimeType duration_;
+  std::size_t appended_;
+
+  mutable boost::mutex mutex_;
+  mutable boost::condition_variable published_;
+
+}; // StreamingSeriesCollection
+
+// Parses one line of whitespace-separated integers.
+template <typename TimeType>
+void parse_time_series_line(const char* first, const char* last,
+                            std::vector<TimeType>& series) {
+
+  while (first != last) {
+    if ((*first == ' ') || (*first == '\t') || (*first == '\r')) {
+      ++first;
+      continue;
+    }
+
+    bool negative = (*first == '-');
+    if (negative || (*first == '+')) {
+      ++first;
+    }
+
+    TimeType value = 0;
+    while ((first != last) && (*first >= '0') && (*first <= '9')) {
+      value = (value * 10) + (*first - '0');
+      ++first;
+    }
+
+    series.push_back(negative ? -value : value);
+
+    // Skip anything that is not part of a number
+    while ((first != last) && (*first != ' ') && (*first != '\t') && (*first != '\r')) {
+      ++first;
+    }
+  }
+}
+
+// Reads an ASCII time series file (same format as read_time_series_file) in
+// chunks of PIPELINE_CHUNK_SIZE bytes, publishing the series of every chunk as
+// soon as it is parsed. Always finishes the collection. Returns false if the
+// file could not be opened or has no duration line.
+template <typename TimeType>
+bool stream_time_series_file(const std::string& path,
+                             StreamingSeriesCollection<TimeType>& all_series) {
+
+  std::ifstream in_file(path.c_str(), std::ios::binary);
+  std::vector<char> buffer;
+  std::size_t pending = 0;
+  bool have_duration = false;
+
+  while (in_file) {
+    buffer.resize(pending + PIPELINE_CHUNK_SIZE);
+    in_file.read(&buffer[pending], PIPELINE_CHUNK_SIZE);
+
+    const std::size_t filled = pending + in_file.gcount();
+    const bool at_end = !in_file;
+    const char* line = &buffer[0];
+    const char* end = line + filled;
+
+    while (line != end) {
+      const char* line_end = std::find(line, end, '\n');
+
+      // Keep a partial line for the next chunk
+      if ((line_end == end) && !at_end) {
+        break;
+      }
+
+      if (!have_duration) {
+        std::vector<TimeType> duration;
+        parse_time_series_line(line, line_end, duration);
+
+        if (duration.empty()) {
+          all_series.finish();
+          return (false);
+        }
+
+        all_series.set_duration(duration[0]);
+        have_duration = true;
+      }
+      else {
+        std::vector<TimeType>& series = all_series.append();
+        parse_time_series_line(line, line_end, series);
+
+        // Needed to terminate TE code counting loop
+        series.push_back(std::numeric_limits<TimeType>::max());
+      }
+
+      line = (line_end == end) ? end : line_end + 1;
+    }
+
+    pending = end - line;
+    std::copy(line, end, buffer.begin());
+
+    all_series.publish();
+  }
+
+  all_series.finish();
+  return (have_duration);
+}
+
+// Receives finished rows and writes them in the binary result format. Rows
+// are written at their offsets in any order; the header is written last,
+// once the number of rows is known.
+class BinaryRowWriter {
+
+public:
+  explicit BinaryRowWriter(const std::string& path) :
+    out_(path.c_str(), std::ios::binary | std::ios::trunc) { }
+
+  // Records the calculation in the header (see ResultHeader)
+  void set_parameters(std::size_t x_order, std::size_t y_order,
+                      boost::uint64_t y_delay, boost::uint64_t duration) {
+    header_.set_parameters(x_order, y_order, y_delay, duration);
+  }
+
+  void write_row(std::size_t i, const double* values, std::size_t cols) {
+    header_.cols = cols;
+    out_.seekp(header_.row_offset(i));
+    out_.write(reinterpret_cast<const char*>(values), cols * sizeof(double));
+  }
+
+  void finish(std::size_t series_count,
+              std::size_t row_start, std::size_t rows,
+              std::size_t col_start, std::size_t cols) {
+    header_.series_count = series_count;
+    header_.row_start = row_start;
+    header_.rows = rows;
+    header_.col_start = col_start;
+    header_.cols = cols;
+
+    out_.seekp(0);
+    write_result_header(out_, header_);
+  }
+
+private:
+  std::ofstream out_;
+  ResultHeader header_;
+};
+
+// Receives finished rows and writes the whole block in the (transposed) ASCII
+// format once all rows are in.
+class TextRowWriter {
+
+public:
+  explicit TextRowWriter(const std::string& path) : path_(path) { }
+
+  void write_row(std::size_t i, const double* values, std::size_t cols) {
+    if (rows_.size() <= i) {
+      rows_.resize(i + 1);
+    }
+
+    rows_[i].assign(values, values + cols);
+  }
+
+  void finish(std::size_t, std::size_t, std::size_t rows,
+              std::size_t, std::size_t cols) {
+    std::ofstream out_file(path_.c_str());
+    write_result_text(out_file, rows_, rows, cols);
+  }
+
+private:
+  std::string path_;
+  std::vector< std::vector<double> > rows_;
+};
+
+// One row of a result matrix as seen by transent_ho for a 1-row block
+struct PipelineResultRow {
+  double* values;
+
+  double* operator[](std::size_t) const {
+    return (values);
+  }
+};
+
+// Finished row handed from a worker to the writer, which deletes values
+struct PipelineRow {
+  std::size_t row, cols;
+  std::vector<double>* values;
+};
+
+// Capacity of the finished row queue
+#define PIPELINE_QUEUE_SIZE 1024
+
+// Yields for the first waits, then sleeps, so an idle side of a lock-free
+// queue does not take a core away from the others.
+inline void pipeline_backoff(std::size_t& waits) {
+  if (++waits < 64) {
+    boost::this_thread::yield();
+  }
+  else {
+    boost::this_thread::sleep(boost::posix_time::microseconds(100));
+  }
+}
+
+// Schedules a block calculation over a StreamingSeriesCollection. Every row
+// whose predicted time series has been read is advanced over the predictor
+// series read so far, so the workers compute all pairs available during
+// reading rather than a few rows. A row is finished (and queued for the
+// writer) once its last column is done; rows still in progress keep their
+// values, so peak memory is at most that of the whole block.
+template <typename TimeType>
+class TransentPipeline {
+
+public:
+  TransentPipeline(const StreamingSeriesCollection<TimeType>& all_series,
+                   std::size_t x_order, std::size_t y_order, TimeType y_delay,
+                   std::size_t row_start, std::size_t rows,
+                   std::size_t col_start, std::size_t cols,
+                   std::size_t threads) :
+    all_series_(all_series), x_order_(x_order), y_order_(y_order),
+    y_delay_(y_delay), row_start_(row_start), rows_(rows),
+    col_start_(col_start), cols_(cols), threads_(threads),
+    done_rows_(PIPELINE_QUEUE_SIZE), seen_series_(0), next_row_(row_start),
+    workers_left_(threads) { }
+
+  // Computes the block and hands every row to writer.write_row(i, values,
+  // cols) on the calling thread (in no particular order), then calls
+  // writer.finish(series_count, row_start, rows, col_start, cols). The block
+  // can only be checked once the whole input is read: if it does not lie
+  // within the time series of in_file_path, returns false with the problem in
+  // error (see resolve_block) without calling writer.finish.
+  template <typename RowWriter>
+  bool run(RowWriter& writer, const std::string& in_file_path, std::string& error) {
+
+    boost::thread_group workers;
+
+    for (std::size_t t = 0; t < threads_; ++t) {
+      workers.create_thread(boost::bind(&TransentPipeline::work, this));
+    }
+
+    PipelineRow done;
+    std::size_t waits = 0;
+
+    while (true) {
+      if (done_rows_.pop(done)) {
+        writer.write_row(done.row, done.values->data(), done.cols);
+        delete done.values;
+
+        waits = 0;
+      }
+      else if (workers_left_.load(boost::memory_order_acquire) == 0) {
+
+        // Workers push before they leave, so the queue is final now
+        if (done_rows_.empty()) {
+          break;
+        }
+      }
+      else {
+        pipeline_backoff(waits);
+      }
+    }
+
+    workers.join_all();
+
+    const std::size_t series_count = all_series_.size();
+    std::ptrdiff_t rows = rows_, cols = cols_;
+
+    if (!resolve_block(in_file_path, series_count, (std::ptrdiff_t)row_start_, rows,
+                       (std::ptrdiff_t)col_start_, cols, error)) {
+      return (false);
+    }
+
+    writer.finish(series_count, row_start_, rows, col_start_, cols);
+    return (true);
+  }
+
+private:
+  struct RowState {
+    std::vector<double>* values;
+    std::size_t next_col;
+  };
+
+  void work() {
+
+    std::size_t i, first_col, last_col;
+    std::vector<double>* values;
+
+    while (next_task(i, first_col, last_col, values)) {
+
+      if (last_col > first_col) {
+        values->resize(last_col - col_start_);
+
+        PipelineResultRow result_row = { &(*values)[first_col - col_start_] };
+        transent_ho(all_series_, x_order_, y_order_, y_delay_,
+                    all_series_.duration(), result_row,
+                    i, 1, first_col, last_col - first_col);
+      }
+
+      finish_task(i, last_col);
+    }
+
+    workers_left_.fetch_sub(1, boost::memory_order_release);
+  }
+
+  // Hands out the next (row, column range) to compute. Returns false once
+  // the input is finished and no rows are left to advance.
+  bool next_task(std::size_t& i, std::size_t& first_col, std::size_t& last_col,
+                 std::vector<double>*& values) {
+
+    boost::unique_lock<boost::mutex> lock(mutex_);
+
+    while (true) {
+      const bool finished = all_series_.finished();
+      const std::size_t available = all_series_.size();
+
+      // New series: start the rows they predict and wake up waiting rows
+      if ((available > seen_series_) || (finished && !waiting_.empty())) {
+        seen_series_ = available;
+
+        for (; next_row_ < std::min(available, row_end(available, finished)); ++next_row_) {
+          RowState state = { new std::vector<double>(), col_start_ };
+          row_states_[next_row_] = state;
+          ready_.push_back(next_row_);
+        }
+
+        ready_.insert(ready_.end(), waiting_.begin(), waiting_.end());
+        waiting_.clear();
+      }
+
+      if (!ready_.empty()) {
+        i = ready_.front();
+        ready_.pop_front();
+
+        first_col = row_states_[i].next_col;
+        last_col = std::max(first_col, std::min(seen_series_, col_end(seen_series_, finished)));
+        values = row_states_[i].values;
+
+        return (true);
+      }
+
+      if (finished) {
+        return (false);
+      }
+
+      // Wait for more series without holding up finish_task
+      lock.unlock();
+      all_series_.wait_for(available);
+      lock.lock();
+    }
+  }
+
+  // Records that row i is done up to last_col, and queues it for the writer
+  // if that was its last column
+  void finish_task(std::size_t i, std::size_t last_col) {
+
+    boost::unique_lock<boost::mutex> lock(mutex_);
+
+    RowState& state = row_states_[i];
+    state.next_col = last_col;
+
+    const bool finished = all_series_.finished();
+    const std::size_t available = all_series_.size();
+
+    if ((cols_ && (last_col >= (col_start_ + cols_))) || (finished && (last_col >= available))) {
+      PipelineRow done = { i - row_start_, last_col - col_start_, state.values };
+      row_states_.erase(i);
+      lock.unlock();
+
+      while (!done_rows_.push(done)) {
+        boost::this_thread::yield();
+      }
+    }
+    else if (available > seen_series_) {
+      ready_.push_back(i);
+    }
+    else {
+      waiting_.push_back(i);
+    }
+  }
+
+  // End of the row and column ranges given the series read so far
+  // (unbounded while the input is still being read and rows or cols is 0)
+  std::size_t row_end(std::size_t available, bool finished) const {
+    return (rows_ ? (row_start_ + rows_) : (finished ? available : std::numeric_limits<std::size_t>::max()));
+  }
+
+  std::size_t col_end(std::size_t available, bool finished) const {
+    return (cols_ ? (col_start_ + cols_) : (finished ? available : std::numeric_limits<std::size_t>::max()));
+  }
+
+  const StreamingSeriesCollection<TimeType>& all_series_;
+  const std::size_t x_order_, y_order_;
+  const TimeType y_delay_;
+  const std::size_t row_start_, rows_, col_start_, cols_, threads_;
+
+  boost::lockfree::queue<PipelineRow, boost::lockfree::fixed_sized<true> > done_rows_;
+
+  // Scheduler state, guarded by mutex_
+  boost::mutex mutex_;
+  std::map<std::size_t, RowState> row_states_;
+  std::deque<std::size_t> ready_, waiting_;
+  std::size_t seen_series_, next_row_;
+
+  boost::atomic<std::size_t> workers_left_;
+
+}; // TransentPipeline
+
+template <typename TimeType>
+void pipeline_read(const std::string& path,
+                   StreamingSeriesCollection<TimeType>& all_series,
+                   bool& read_ok) {
+  read_ok = stream_time_series_file(path, all_series);
+}
+
+// Calculates a (rows)x(cols) block (0 for the remainder) with the run-time
+// transent_ho while the input file is still being read on another thread.
+// Rows are computed on `threads` worker threads and written by writer on the
+// calling thread. Returns false and describes the problem in error if the
+// input could not be read or the block does not lie within it (in which case
+// writer.finish is not called).
+template <typename TimeType, typename RowWriter>
+bool transent_ho_pipeline(const std::string& in_file_path,
+                          std::size_t x_order, std::size_t y_order, TimeType y_delay,
+                          std::size_t row_start, std::size_t rows,
+                          std::size_t col_start, std::size_t cols,
+                          std::size_t threads, RowWriter& writer,
+                          std::string& error) {
+
+  StreamingSeriesCollection<TimeType> all_series;
+  bool read_ok = false;
+
+  boost::thread reader(boost::bind(&pipeline_read<TimeType>, boost::cref(in_file_path),
+                                   boost::ref(all_series), boost::ref(read_ok)));
+
+  TransentPipeline<TimeType> pipeline(all_series, x_order, y_order, y_delay,
+                                      row_start, rows, col_start, cols,
+                                      std::max(threads, (std::size_t)1));
+  const bool block_ok = pipeline.run(writer, in_file_path, error);
+
+  reader.join();
+
+  if (!read_ok) {
+    error = "Unable to read input file " + in_file_path;
+    return (false);
+  }
+
+  return (block_ok);
+}
+
+#endif // TE_PIPELINE_HPP
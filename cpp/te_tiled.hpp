@@ -0,0 +1,369 @@
+/*=============================================================================
+Copyright (c) 2011, The Trustees of Indiana University
+All rights reserved.
+
+Authors: Michael Hansen (mihansen@indiana.edu), Shinya Ito
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of Indiana University nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+=============================================================================*/
+
+
+#ifndef TE_TILED_HPP
+#define TE_TILED_HPP
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+
+#include <boost/cstdint.hpp>
+#include <boost/limits.hpp>
+
+#include "transent.hpp"
+#include "spike_store.hpp"
+#include "te_io.hpp"
+
+// =============================================================================
+// Out-of-core tiled calculation
+//
+// Time series are kept in a seekable binary spike store file (the SpikeStore
+// layout on disk), so any contiguous range of series can be read with one
+// seek. A block is calculated one row tile at a time: the row tile stays in
+// memory while the column tiles of the block are read in turn, and its result
+// rows are written before the next row tile is read. Tile sizes are chosen
+// from the exact spike counts in the file so that the spike data and result
+// rows in memory stay within a given budget.
+// =============================================================================
+
+// Spike store file header. The header is followed by the times of all series
+// (each followed by a terminating element, as in SpikeStore) and then by
+// series_count + 1 uint64 offsets into the times.
+struct SpikeStoreFileHeader {
+  char magic[4];
+  boost::uint32_t version;
+  boost::uint32_t time_size;
+  boost::uint32_t reserved;
+  boost::uint64_t series_count;
+  boost::int64_t duration;
+  boost::uint64_t times;
+
+  SpikeStoreFileHeader() :
+    version(1), time_size(0), reserved(0), series_count(0), duration(0), times(0) {
+    std::memcpy(magic, "TESS", 4);
+  }
+
+  bool valid() const {
+    return ((std::memcmp(magic, "TESS", 4) == 0) && (version == 1));
+  }
+
+  // Byte offset of the offsets array
+  boost::uint64_t offsets_offset() const {
+    return (sizeof(SpikeStoreFileHeader) + (times * time_size));
+  }
+};
+
+// Converts an ASCII time series file into a spike store file one line at a
+// time, so the time series never have to fit in memory. Returns false if the
+// input cannot be read or a series is not sorted.
+template <typename TimeType>
+bool write_spike_store_file(const std::string& in_file_path,
+                            const std::string& store_file_path) {
+
+  std::ifstream in_file(in_file_path.c_str());
+  std::ofstream out_file(store_file_path.c_str(), std::ios::binary | std::ios::trunc);
+  std::string line;
+  TimeType duration;
+
+  if (!in_file || !out_file || !getline(in_file, line)) {
+    return (false);
+  }
+
+  std::istringstream duration_stream(line);
+
+  if (!(duration_stream >> duration)) {
+    return (false);
+  }
+
+  SpikeStoreFileHeader header;
+  header.time_size = sizeof(TimeType);
+  header.duration = duration;
+
+  out_file.write(reinterpret_cast<const char*>(&header), sizeof(SpikeStoreFileHeader));
+
+  std::vector<boost::uint64_t> offsets(1, 0);
+  std::vector<TimeType> series;
+
+  while (getline(in_file, line)) {
+    std::istringstream line_stream(line);
+
+    series.clear();
+    std::copy(std::istream_iterator<TimeType>(line_stream),
+              std::istream_iterator<TimeType>(),
+              std::back_inserter(series));
+
+    if (!line_stream.eof()) {
+      return (false);
+    }
+
+    for (std::size_t t = 1; t < series.size(); ++t) {
+      if (series[t] < series[t - 1]) {
+        return (false);
+      }
+    }
+
+    series.push_back(std::numeric_limits<TimeType>::max());
+    out_file.write(reinterpret_cast<const char*>(series.data()), series.size() * sizeof(TimeType));
+    offsets.push_back(offsets.back() + series.size());
+  }
+
+  out_file.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(boost::uint64_t));
+
+  header.series_count = offsets.size() - 1;
+  header.times = offsets.back();
+
+  out_file.seekp(0);
+  out_file.write(reinterpret_cast<const char*>(&header), sizeof(SpikeStoreFileHeader));
+  out_file.close();
+
+  return (!out_file.fail());
+}
+
+// Reads contiguous ranges of time series from a spike store file. Only the
+// header and the offsets are kept in memory.
+template <typename TimeType>
+class SpikeStoreFile {
+
+public:
+  // Returns false if the file is not a spike store file of TimeType
+  bool open(const std::string& path) {
+    in_.open(path.c_str(), std::ios::binary);
+    in_.read(reinterpret_cast<char*>(&header_), sizeof(SpikeStoreFileHeader));
+
+    if (!in_ || !header_.valid() || (header_.time_size != sizeof(TimeType))) {
+      return (false);
+    }
+
+    offsets_.resize(header_.series_count + 1);
+    in_.seekg(header_.offsets_offset());
+    in_.read(reinterpret_cast<char*>(offsets_.data()), offsets_.size() * sizeof(boost::uint64_t));
+
+    return (bool(in_));
+  }
+
+  std::size_t size() const { return (header_.series_count); }
+  TimeType duration() const { return ((TimeType)header_.duration); }
+
+  // Bytes of series [first, first + count) in memory (terminators included)
+  std::size_t bytes(std::size_t first, std::size_t count) const {
+    return ((offsets_[first + count] - offsets_[first]) * sizeof(TimeType));
+  }
+
+  // Replaces the contents of store by series [first, first + count)
+  bool read(std::size_t first, std::size_t count, SpikeStore<TimeType>& store) {
+    std::vector<TimeType>& times = store.times();
+    std::vector<std::size_t>& offsets = store.offsets();
+
+    times.resize(offsets_[first + count] - offsets_[first]);
+    offsets.resize(count + 1);
+
+    for (std::size_t k = 0; k <= count; ++k) {
+      offsets[k] = offsets_[first + k] - offsets_[first];
+    }
+
+    in_.seekg(sizeof(SpikeStoreFileHeader) + (offsets_[first] * sizeof(TimeType)));
+    in_.read(reinterpret_cast<char*>(times.data()), times.size() * sizeof(TimeType));
+    bytes_read_ += times.size() * sizeof(TimeType);
+
+    return (bool(in_));
+  }
+
+  // Bytes of times read so far
+  boost::uint64_t bytes_read() const { return (bytes_read_); }
+
+  SpikeStoreFile() : bytes_read_(0) { }
+
+private:
+  std::ifstream in_;
+  SpikeStoreFileHeader header_;
+  std::vector<boost::uint64_t> offsets_;
+  boost::uint64_t bytes_read_;
+};
+
+// The series of a row tile followed by those of a column tile, as one
+// collection for transent_ho
+template <typename TimeType>
+struct TiledSeries {
+  typedef typename SpikeStore<TimeType>::value_type value_type;
+
+  const SpikeStore<TimeType>* rows;
+  const SpikeStore<TimeType>* cols;
+
+  value_type operator[](std::size_t i) const {
+    return ((i < rows->size()) ? (*rows)[i] : (*cols)[i - rows->size()]);
+  }
+
+  std::size_t size() const { return (rows->size() + cols->size()); }
+};
+
+// Columns cols_shift .. of the result rows of a row tile
+struct TiledResult {
+  double* values;
+  std::size_t stride, shift;
+
+  double* operator[](std::size_t i) const {
+    return (values + (i * stride) + shift);
+  }
+};
+
+// Splits series [first, first + count) into consecutive tiles whose spike
+// data plus extra_bytes per series take at most budget bytes. bounds receives
+// the first series of every tile and first + count. Returns false, with the
+// offending series in too_large, if a single series does not fit the budget.
+template <typename TimeType>
+bool tiled_bounds(const SpikeStoreFile<TimeType>& store_file,
+                  std::size_t first, std::size_t count,
+                  double budget, double extra_bytes,
+                  std::vector<std::size_t>& bounds,
+                  std::size_t& too_large) {
+
+  bounds.assign(1, first);
+
+  while (bounds.back() < (first + count)) {
+    const std::size_t tile_first = bounds.back();
+    std::size_t tile_last = tile_first + 1;
+
+    if ((store_file.bytes(tile_first, 1) + extra_bytes) > budget) {
+      too_large = tile_first;
+      return (false);
+    }
+
+    while ((tile_last < (first + count)) &&
+           ((store_file.bytes(tile_first, tile_last + 1 - tile_first) +
+             ((tile_last + 1 - tile_first) * extra_bytes)) <= budget)) {
+      ++tile_last;
+    }
+
+    bounds.push_back(tile_last);
+  }
+
+  return (true);
+}
+
+// Statistics of an out-of-core calculation
+struct TiledStats {
+  std::size_t row_tiles, col_tiles;
+  boost::uint64_t bytes_read;
+  double peak_bytes;
+};
+
+// Calculates the (rows)x(cols) block at (row_start, col_start) of the time
+// series in store_file with the run-time transent_ho, holding at most
+// memory_budget bytes of spike data and result rows: half for a row tile and
+// its result rows, half for a column tile. Finished rows are passed to
+// writer.write_row(i, values, cols) with block-relative i (see
+// BinaryRowWriter), and writer.finish is called at the end. Returns false with
+// a message in error, before anything is written, if a row tile of one series
+// (with its result row) or a column tile of one series exceeds its half.
+template <typename TimeType, typename RowWriter>
+bool transent_ho_tiled
+(SpikeStoreFile<TimeType>& store_file,
+ const std::size_t x_order, const std::size_t y_order,
+ const TimeType y_delay,
+ const double memory_budget,
+ RowWriter& writer,
+ std::size_t row_start, std::size_t rows,
+ std::size_t col_start, std::size_t cols,
+ TiledStats& stats, std::string& error) {
+
+  const TimeType duration = store_file.duration();
+
+  // Rows carry their result values
+  std::vector<std::size_t> row_bounds, col_bounds;
+  const double row_bytes = (double)cols * sizeof(double);
+  std::size_t too_large = 0;
+
+  const bool rows_fit =
+    tiled_bounds(store_file, row_start, rows, memory_budget / 2, row_bytes, row_bounds, too_large);
+
+  if (!rows_fit || !tiled_bounds(store_file, col_start, cols, memory_budget / 2, 0, col_bounds, too_large)) {
+    const bool row = !rows_fit;
+
+    std::ostringstream message;
+    message << "Time series " << too_large << " needs "
+            << ((store_file.bytes(too_large, 1) + (row ? row_bytes : 0)) / (1024.0 * 1024.0))
+            << " MB as a " << (row ? "row" : "column") << " tile, more than half of the memory budget ("
+            << (memory_budget / (1024.0 * 1024.0)) << " MB)";
+    error = message.str();
+
+    return (false);
+  }
+
+  stats.row_tiles = row_bounds.size() - 1;
+  stats.col_tiles = col_bounds.size() - 1;
+  stats.bytes_read = 0;
+  stats.peak_bytes = 0;
+
+  SpikeStore<TimeType> row_tile, col_tile;
+  std::vector<double> values;
+
+  for (std::size_t r = 0; (r + 1) < row_bounds.size(); ++r) {
+    const std::size_t tile_rows = row_bounds[r + 1] - row_bounds[r];
+
+    store_file.read(row_bounds[r], tile_rows, row_tile);
+    values.assign(tile_rows * cols, 0);
+
+    for (std::size_t c = 0; (c + 1) < col_bounds.size(); ++c) {
+      const std::size_t tile_cols = col_bounds[c + 1] - col_bounds[c];
+
+      store_file.read(col_bounds[c], tile_cols, col_tile);
+
+      stats.peak_bytes = std::max(stats.peak_bytes,
+        (double)(store_file.bytes(row_bounds[r], tile_rows) + store_file.bytes(col_bounds[c], tile_cols) +
+                 (values.size() * sizeof(double))));
+
+      TiledSeries<TimeType> tile_series = { &row_tile, &col_tile };
+      TiledResult tile_result = { values.data(), cols, col_bounds[c] - col_start };
+
+      transent_ho(tile_series, x_order, y_order, y_delay, duration, tile_result,
+                  0, tile_rows, tile_rows, tile_cols);
+    }
+
+    for (std::size_t i = 0; i < tile_rows; ++i) {
+      writer.write_row((row_bounds[r] - row_start) + i, &values[i * cols], cols);
+    }
+  }
+
+  writer.finish(store_file.size(), row_start, rows, col_start, cols);
+  stats.bytes_read = store_file.bytes_read();
+
+  return (true);
+
+} // transent_ho_tiled
+
+#endif // TE_TILED_HPP
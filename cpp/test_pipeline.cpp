@@ -0,0 +1,173 @@
+/*=============================================================================
+Copyright (c) 2011, The Trustees of Indiana University
+All rights reserved.
+
+Authors: Michael Hansen (mihansen@indiana.edu), Shinya Ito
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of Indiana University nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+=============================================================================*/
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/multi_array.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_01.hpp>
+
+#include "transent.hpp"
+#include "spike_store.hpp"
+#include "te_pipeline.hpp"
+
+// Checks that te_block --pipeline gives the same block as the run-time
+// transent_ho on a SpikeStore, for an input with empty time series and for
+// several thread counts, and that blocks outside the input are rejected.
+// Exits with 1 on any difference.
+// Usage: test_pipeline
+
+typedef int TimeType;
+typedef boost::multi_array<double, 2> ResultMatrix;
+
+// Keeps the rows handed over by TransentPipeline
+struct MatrixRowWriter {
+  std::vector< std::vector<double> > rows;
+
+  void write_row(std::size_t i, const double* values, std::size_t cols) {
+    if (rows.size() <= i) {
+      rows.resize(i + 1);
+    }
+
+    rows[i].assign(values, values + cols);
+  }
+
+  void finish(std::size_t, std::size_t, std::size_t, std::size_t, std::size_t) {
+    finished = true;
+  }
+
+  bool finished;
+
+  MatrixRowWriter() : finished(false) { }
+};
+
+// Returns true if the pipeline rejects the block without finishing the output
+bool check_rejected(const std::string& path, std::size_t row_start, std::size_t rows,
+                    std::size_t col_start, std::size_t cols) {
+
+  MatrixRowWriter writer;
+  std::string error;
+  const bool rejected = !transent_ho_pipeline(path, 1, 1, 1, row_start, rows, col_start, cols,
+                                              2, writer, error) &&
+                        !writer.finished && !error.empty();
+
+  std::cout << "rows " << row_start << "+" << rows << ", cols " << col_start << "+" << cols
+            << ": " << (rejected ? "rejected" : "FAILED") << std::endl;
+
+  return (rejected);
+}
+
+// Returns true if the pipelined block equals the block from the SpikeStore
+bool check_block(const std::string& path, const SpikeStore<TimeType>& store, TimeType duration,
+                 std::size_t x_order, std::size_t y_order, TimeType y_delay,
+                 std::size_t row_start, std::size_t rows,
+                 std::size_t col_start, std::size_t cols, std::size_t threads) {
+
+  ResultMatrix expected(boost::extents[rows][cols]);
+  transent_ho(store, x_order, y_order, y_delay, duration, expected,
+              row_start, rows, col_start, cols);
+
+  MatrixRowWriter writer;
+  std::string error;
+  bool same = transent_ho_pipeline(path, x_order, y_order, y_delay,
+                                   row_start, rows, col_start, cols, threads, writer, error) &&
+              (writer.rows.size() == rows);
+
+  for (std::size_t i = 0; same && (i < rows); ++i) {
+    same = (writer.rows[i].size() == cols) &&
+           std::equal(writer.rows[i].begin(), writer.rows[i].end(), expected[i].begin());
+  }
+
+  std::cout << "orders " << x_order << "/" << y_order << ", delay " << y_delay
+            << ", rows " << row_start << "+" << rows << ", cols " << col_start << "+" << cols
+            << ", " << threads << " threads: " << (same ? "ok" : "FAILED") << std::endl;
+
+  return (same);
+}
+
+int main() {
+
+  const std::size_t num_series = 12;
+  const TimeType duration = 20000;
+
+  // Random spike trains; series 2, 7 and the last one are empty
+  boost::mt19937 rng(42);
+  boost::uniform_01<boost::mt19937&> uniform(rng);
+
+  const boost::filesystem::path path =
+    boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("te-pipeline-%%%%%%%%.txt");
+  std::ofstream out_file(path.string().c_str());
+  SpikeStore<TimeType> store;
+
+  out_file << duration << std::endl;
+
+  for (std::size_t i = 0; i < num_series; ++i) {
+    const double rate = ((i == 2) || (i == 7) || (i == num_series - 1)) ? 0 : 0.01 * (0.5 + uniform());
+    std::vector<TimeType> series;
+
+    for (TimeType t = 1; t <= duration; ++t) {
+      if (uniform() < rate) {
+        series.push_back(t);
+        out_file << t << " ";
+      }
+    }
+
+    out_file << std::endl;
+    store.push_back(series);
+  }
+
+  out_file.close();
+
+  const std::size_t thread_counts[] = { 1, 2, 4 };
+  bool same = true;
+
+  for (std::size_t t = 0; t < 3; ++t) {
+    same = check_block(path.string(), store, duration, 1, 1, 1,
+                       0, num_series, 0, num_series, thread_counts[t]) && same;
+    same = check_block(path.string(), store, duration, 2, 3, 2,
+                       0, num_series, 0, num_series, thread_counts[t]) && same;
+    same = check_block(path.string(), store, duration, 2, 1, 1,
+                       1, 8, 2, 10, thread_counts[t]) && same;
+  }
+
+  same = check_rejected(path.string(), 25, 0, 0, 0) && same;
+  same = check_rejected(path.string(), 8, 10, 0, 0) && same;
+  same = check_rejected(path.string(), 0, 0, 3, 20) && same;
+
+  boost::filesystem::remove(path);
+
+  return (same ? 0 : 1);
+}
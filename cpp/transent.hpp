@@ -30,19 +30,55 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 =============================================================================*/
 
+#ifndef TRANSENT_HPP
+#define TRANSENT_HPP
+
 #include <bitset>
 #include <cmath>
 #include <algorithm>
 #include <numeric>
 #include <cassert>
+#include <vector>
+#include <utility>
+#include <iterator>
+#include <functional>
 
 #include <boost/mpl/arithmetic.hpp>
 #include <boost/static_assert.hpp>
 #include <boost/mpl/plus.hpp>
+#include <boost/mpl/if.hpp>
 #include <boost/limits.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/math/distributions/normal.hpp>
+
+#ifdef __SSE2__
+  #include <emmintrin.h>
+#endif
 
 #define MAX_XY_ORDER 64
 
+// Code widths (1 + x_order + y_order) at which the compile-time transent_ho
+// switches from a dense count table to a CodeCounter (see below)
+#ifndef TRANSENT_DENSE_CODE_BITS
+  #define TRANSENT_DENSE_CODE_BITS 14
+#endif
+
+#ifndef TRANSENT_TABLE_CODE_BITS
+  #define TRANSENT_TABLE_CODE_BITS 24
+#endif
+
+#ifndef TRANSENT_RADIX_BITS
+  #define TRANSENT_RADIX_BITS 11
+#endif
+
+// Spike density (see transent_walk_bitmaps) at which the code walk switches
+// from one time per step to 64 time bins per step
+#ifndef TRANSENT_BITMAP_MIN_SPIKES
+  #define TRANSENT_BITMAP_MIN_SPIKES 8
+#endif
+
 namespace mpl = boost::mpl;
 namespace boost { namespace mpl {
   template <std::size_t N, std::size_t Power>
@@ -59,6 +95,413 @@ namespace boost { namespace mpl {
 
 } }
 
+// Same as std::lower_bound. Kernels find the start of every history with it,
+// so iterator types with a cheaper search overload it for their own type
+// (see compressed_store.hpp), found by argument-dependent lookup.
+template <typename Iterator, typename Value>
+Iterator transent_lower_bound(Iterator first, Iterator last, const Value& value) {
+  return (std::lower_bound(first, last, value));
+}
+
+// Computes transfer entropy from a table of joint code counts, where the
+// zero code count has already been filled in and total is the number of time
+// bins the counts were taken over. Code bit 0 is x(n+1), bits 1..x_order are
+// x^(k) and the remaining y_order bits are y^(l).
+template <typename CountTable>
+double transent_from_counts
+(const CountTable& counts,
+ const std::size_t x_order, const std::size_t y_order,
+ const double total) {
+
+  const std::size_t num_counts = (std::size_t)1 << (1 + x_order + y_order),
+                    num_x = (std::size_t)1 << (x_order + 1);
+
+  // Marginal counts of x^(k+1), summed over y^(l) once instead of once per code
+  std::vector<double> x_counts(num_x);
+
+  for (std::size_t k = 0; k < num_counts; ++k) {
+    x_counts[k & (num_x - 1)] += counts[k];
+  }
+
+  double te_final = 0, prob_2, prob_3;
+  std::size_t x_code;
+
+  for (std::size_t k = 0; k < num_counts; ++k) {
+    if (counts[k] == 0) {
+      continue;
+    }
+
+    prob_2 = (double)counts[k] / (double)(counts[k] + counts[k ^ 1]);
+
+    x_code = k & (num_x - 1);
+    prob_3 = x_counts[x_code] / (x_counts[x_code] + x_counts[x_code ^ 1]);
+
+    te_final += ((double)counts[k] * (log2(prob_2) - log2(prob_3)));
+  }
+
+  return ((total > 0) ? (te_final / total) : 0);
+
+} // transent_from_counts
+
+// Counts the joint codes of one pair for code tables too large to clear and
+// scan for every pair (more than TRANSENT_DENSE_CODE_BITS bits) and computes
+// transfer entropy from them, without touching the whole 2^(1+k+l) table:
+// - Up to TRANSENT_TABLE_CODE_BITS bits, codes are counted into a table that
+//   stays zeroed between pairs. A code is recorded when its count leaves
+//   zero, and only the recorded codes are sorted, read and reset afterwards.
+// - Wider codes (whose table would not fit in memory) are buffered, radix
+//   sorted in passes over 2^TRANSENT_RADIX_BITS buckets and run-length
+//   counted.
+// The nonzero codes then come out in increasing order, and transfer entropy is
+// summed over them only. Tables and buffers are kept between pairs.
+template <typename CodeType, std::size_t code_bits>
+class CodeCounter {
+
+public:
+  CodeCounter() : num_codes_(0) { }
+
+  // Starts a new pair that will add at most max_codes codes
+  void clear(const std::size_t max_codes) {
+    if (buffered()) {
+      if (codes_.size() < max_codes) {
+        codes_.resize(max_codes);
+      }
+    }
+    else if (counts_.empty()) {
+      counts_.resize((std::size_t)1 << code_bits);
+    }
+
+    num_codes_ = 0;
+  }
+
+  void add(const CodeType code) {
+    if (buffered()) {
+      codes_[num_codes_] = code;
+    }
+    else if ((counts_[code])++ == 0) {
+      touched_.push_back(code);
+    }
+
+    ++num_codes_;
+  }
+
+  // Same result as transent_from_counts on the equivalent count table, where
+  // the zero code takes up the time bins not covered by an added code.
+  double transent(const std::size_t x_order, const std::size_t y_order,
+                  const double total) {
+
+    assert((1 + x_order + y_order) == code_bits);
+
+    runs_.clear();
+
+    // Zero code first
+    if (total > (double)num_codes_) {
+      runs_.push_back(std::make_pair((CodeType)0, total - (double)num_codes_));
+    }
+
+    if (buffered()) {
+      sort();
+
+      for (std::size_t c = 0; c < num_codes_; ) {
+        std::size_t next = c + 1;
+
+        while ((next < num_codes_) && (codes_[next] == codes_[c])) {
+          ++next;
+        }
+
+        runs_.push_back(std::make_pair(codes_[c], (double)(next - c)));
+        c = next;
+      }
+    }
+    else {
+      std::sort(touched_.begin(), touched_.end());
+
+      for (std::size_t t = 0; t < touched_.size(); ++t) {
+        runs_.push_back(std::make_pair(touched_[t], (double)counts_[touched_[t]]));
+        counts_[touched_[t]] = 0;
+      }
+
+      touched_.clear();
+    }
+
+    return (transent_runs(x_order, total));
+  }
+
+private:
+  static bool buffered() {
+    return (code_bits > TRANSENT_TABLE_CODE_BITS);
+  }
+
+  // Least significant digit first radix sort of the buffered codes
+  void sort() {
+
+    const std::size_t passes = (code_bits + TRANSENT_RADIX_BITS - 1) / TRANSENT_RADIX_BITS,
+                      digit_bits = (code_bits + passes - 1) / passes,
+                      num_buckets = (std::size_t)1 << digit_bits;
+
+    std::size_t buckets[(std::size_t)1 << TRANSENT_RADIX_BITS];
+
+    if (scratch_.size() < codes_.size()) {
+      scratch_.resize(codes_.size());
+    }
+
+    for (std::size_t pass = 0; pass < passes; ++pass) {
+      const std::size_t shift = pass * digit_bits;
+
+      std::fill(buckets, buckets + num_buckets, 0);
+
+      for (std::size_t c = 0; c < num_codes_; ++c) {
+        ++(buckets[(codes_[c] >> shift) & (num_buckets - 1)]);
+      }
+
+      std::size_t offset = 0, bucket_size;
+
+      for (std::size_t b = 0; b < num_buckets; ++b) {
+        bucket_size = buckets[b];
+        buckets[b] = offset;
+        offset += bucket_size;
+      }
+
+      for (std::size_t c = 0; c < num_codes_; ++c) {
+        scratch_[buckets[(codes_[c] >> shift) & (num_buckets - 1)]++] = codes_[c];
+      }
+
+      codes_.swap(scratch_);
+    }
+  }
+
+  // transent_from_counts over the nonzero (code, count) runs in code order
+  double transent_runs(const std::size_t x_order, const double total) {
+
+    const std::size_t num_x = (std::size_t)1 << (x_order + 1);
+
+    // Marginal counts of x^(k+1)
+    x_counts_.assign(num_x, 0);
+
+    for (std::size_t r = 0; r < runs_.size(); ++r) {
+      x_counts_[runs_[r].first & (num_x - 1)] += runs_[r].second;
+    }
+
+    double te_final = 0, count, other_count, prob_2, prob_3;
+    std::size_t x_code;
+
+    for (std::size_t r = 0; r < runs_.size(); ++r) {
+      const CodeType code = runs_[r].first;
+      count = runs_[r].second;
+
+      // Codes differing only in x(n+1) are neighbours in code order
+      other_count = 0;
+
+      if (code & 1) {
+        if ((r > 0) && (runs_[r - 1].first == (code ^ 1))) {
+          other_count = runs_[r - 1].second;
+        }
+      }
+      else if (((r + 1) < runs_.size()) && (runs_[r + 1].first == (code ^ 1))) {
+        other_count = runs_[r + 1].second;
+      }
+
+      prob_2 = count / (count + other_count);
+
+      x_code = (std::size_t)(code & (num_x - 1));
+      prob_3 = x_counts_[x_code] / (x_counts_[x_code] + x_counts_[x_code ^ 1]);
+
+      te_final += (count * (log2(prob_2) - log2(prob_3)));
+    }
+
+    return ((total > 0) ? (te_final / total) : 0);
+  }
+
+  std::size_t num_codes_;
+  std::vector<boost::uint32_t> counts_;
+  std::vector<CodeType> touched_, codes_, scratch_;
+  std::vector< std::pair<CodeType, double> > runs_;
+  std::vector<double> x_counts_;
+
+}; // CodeCounter
+
+// Counts visited codes into a dense table
+template <typename CountType>
+struct CodeTableCounter {
+  CountType* counts;
+  std::size_t nonzero;
+
+  CodeTableCounter(CountType* table) : counts(table), nonzero(0) { }
+
+  template <typename TimeType>
+  void operator()(TimeType, std::size_t code) {
+    ++(counts[code]);
+    ++nonzero;
+  }
+};
+
+// Adds visited codes to a CodeCounter
+template <typename Counter, typename CodeType>
+struct CodeCounterAdder {
+  Counter& counter;
+
+  CodeCounterAdder(Counter& code_counter) : counter(code_counter) { }
+
+  template <typename TimeType>
+  void operator()(TimeType, std::size_t code) {
+    counter.add((CodeType)code);
+  }
+};
+
+// Returns the 64 bits of a bitmap starting at bit position pos
+inline boost::uint64_t transent_bitmap_word(const boost::uint64_t* words, const std::size_t pos) {
+  const std::size_t word = pos >> 6, bit = pos & 63;
+  return ((words[word] >> bit) | ((words[word + 1] << 1) << (63 - bit)));
+}
+
+// Returns the position of the highest set bit of a nonzero word
+inline std::size_t transent_highest_bit(const boost::uint64_t word) {
+#ifdef __GNUC__
+  return (63 - __builtin_clzll(word));
+#else
+  std::size_t bit = 63;
+
+  while (((word >> bit) & 1) == 0) {
+    --bit;
+  }
+
+  return (bit);
+#endif
+}
+
+// Fills words with a bitmap of the times 1 .. duration of a series, with time
+// t at bit position duration - t, so that a history (latest time first) is a
+// run of consecutive bits. Returns false if a time repeats.
+template <typename TimeSeries>
+bool transent_fill_bitmap
+(const TimeSeries& series, const typename TimeSeries::value_type duration,
+ std::vector<boost::uint64_t>& words) {
+
+  typedef typename TimeSeries::value_type TimeType;
+
+  words.assign(((std::size_t)duration >> 6) + 3, 0);
+
+  const typename TimeSeries::const_iterator end = series.end();
+
+  for (typename TimeSeries::const_iterator iter = series.begin(); iter != end; ++iter) {
+    const TimeType time = *iter;
+
+    if (time > duration) {
+      break;
+    }
+
+    if (time < 1) {
+      continue;
+    }
+
+    const std::size_t pos = (std::size_t)(duration - time);
+    const boost::uint64_t bit = (boost::uint64_t)1 << (pos & 63);
+
+    if (words[pos >> 6] & bit) {
+      return (false);
+    }
+
+    words[pos >> 6] |= bit;
+  }
+
+  return (true);
+}
+
+// Bit-parallel version of transent_walk_codes for pairs whose spikes, times
+// the number of history bins, average at least TRANSENT_BITMAP_MIN_SPIKES per
+// 64 time bins. Both series are turned into bitmaps
+// (see transent_fill_bitmap), where the code at time t is just two bit
+// fields: x^(k+1) at position end_time - t and y^(l) y_delay bits further.
+// The times with a nonzero code are found 64 at a time, as the OR of the
+// bitmap words shifted by every history bin, so the walk takes a few word
+// operations per 64 bins and per code instead of a data-dependent branch per
+// history bin and code. Returns false (and visits nothing) for sparser pairs
+// and for series with repeated times, which the event walk counts
+// differently.
+template <typename TimeSeries, typename CodeVisitor>
+bool transent_walk_bitmaps
+(const TimeSeries& x_series, const TimeSeries& y_series,
+ const std::size_t x_order, const std::size_t y_order,
+ const typename TimeSeries::value_type y_delay,
+ const typename TimeSeries::value_type end_time,
+ CodeVisitor& visit) {
+
+  // Typedefs
+  typedef typename TimeSeries::value_type TimeType;
+
+  // Constants
+  const std::size_t num_series = 1 + y_order + x_order;
+  const std::size_t window = std::max(y_order + y_delay, x_order + 1);
+  const TimeType duration = end_time + window - 1;
+
+  const boost::uint64_t x_mask = ((boost::uint64_t)1 << (x_order + 1)) - 1,
+                        y_mask = ((boost::uint64_t)1 << y_order) - 1;
+
+  if (end_time < 1) {
+    return (false);
+  }
+
+  // Spikes times history bins, against the bitmap words
+  if (((std::distance(x_series.begin(), x_series.end()) +
+        std::distance(y_series.begin(), y_series.end())) * (std::ptrdiff_t)num_series) <
+      ((std::ptrdiff_t)(duration / 64) * TRANSENT_BITMAP_MIN_SPIKES)) {
+    return (false);
+  }
+
+  // Locals
+  std::vector<boost::uint64_t> x_words, y_words;
+
+  if (!transent_fill_bitmap(x_series, duration, x_words) ||
+      !transent_fill_bitmap(y_series, duration, y_words)) {
+    return (false);
+  }
+
+  // Positions 0 .. end_time - 1 are times end_time .. 1, so later words
+  // come first
+  const std::size_t last_pos = (std::size_t)end_time - 1;
+
+  for (std::size_t word = (last_pos >> 6) + 1; word-- > 0; ) {
+
+    const std::size_t base = word << 6;
+    boost::uint64_t nonzero = 0;
+
+    for (std::size_t k = 0; k <= x_order; ++k) {
+      nonzero |= transent_bitmap_word(&x_words[0], base + k);
+    }
+
+    for (std::size_t k = 0; k < y_order; ++k) {
+      nonzero |= transent_bitmap_word(&y_words[0], base + y_delay + k);
+    }
+
+    if ((last_pos - base) < 63) {
+      nonzero &= ((boost::uint64_t)1 << ((last_pos - base) + 1)) - 1;
+    }
+
+    // The fields at all positions of this word come from 128 bits of each
+    // bitmap
+    const boost::uint64_t x_low = transent_bitmap_word(&x_words[0], base),
+                          x_high = transent_bitmap_word(&x_words[0], base + 64),
+                          y_low = transent_bitmap_word(&y_words[0], base + y_delay),
+                          y_high = transent_bitmap_word(&y_words[0], base + y_delay + 64);
+
+    // Increasing times are decreasing positions
+    while (nonzero != 0) {
+      const std::size_t bit = transent_highest_bit(nonzero);
+
+      nonzero ^= ((boost::uint64_t)1 << bit);
+
+      const boost::uint64_t x_field = (x_low >> bit) | ((x_high << 1) << (63 - bit)),
+                            y_field = (y_low >> bit) | ((y_high << 1) << (63 - bit));
+
+      visit((TimeType)(end_time - (base + bit)),
+            (std::size_t)((x_field & x_mask) | ((y_field & y_mask) << (x_order + 1))));
+    }
+  }
+
+  return (true);
+
+} // transent_walk_bitmaps
+
 // Computes the higher-order transfer entropy matrix for all pairs.
 // x and y orders must be known at compile time.
 template <typename TimeSeriesCollection, typename ResultMatrix,
@@ -81,9 +524,7 @@ void transent_ho
 
   // Constants
   const std::size_t num_series = 1 + y_order + x_order,
-                    num_counts = mpl::pow<2, num_series>::value,
-                    num_x = mpl::pow<2, mpl::plus<mpl::int_<x_order>, mpl::int_<1> >::value>::value,
-                    num_y = mpl::pow<2, y_order>::value;
+                    num_counts = mpl::pow<2, num_series>::value;
 
   BOOST_STATIC_ASSERT(x_order > 0);
   BOOST_STATIC_ASSERT(y_order > 0);
@@ -98,11 +539,19 @@ void transent_ho
     cols = all_series.size();
   }
 
+  // Codes up to 32 bits are sorted as 32-bit integers
+  typedef typename mpl::if_c<(num_series <= 32), boost::uint32_t, boost::uint64_t>::type CodeType;
+
+  // Small code tables are counted in place, larger ones by a CodeCounter
+  const bool dense_counts = (num_series <= TRANSENT_DENSE_CODE_BITS);
+
   // Locals
-  std::vector<TimeType> counts(num_counts);
+  std::vector<TimeType> counts(dense_counts ? num_counts : 0);
+  CodeCounter<CodeType, num_series> counter;
+  CodeCounterAdder<CodeCounter<CodeType, num_series>, CodeType> add_code(counter);
   std::bitset<MAX_XY_ORDER> code;
-  std::size_t idx = 0;
-  double te_final, prob_2, prob_3;
+  std::size_t idx = 0, max_codes;
+  bool walked;
 
   IterShiftPair ord_iter[num_series];
   TimeType ord_times[num_series];
@@ -123,7 +572,7 @@ void transent_ho
       for (std::size_t k = 0; k < (x_order + 1); ++k) {
         shift = (window - 1) - k;
         ord_end[idx] = all_series[i].end();
-        ord_iter[idx] = std::make_pair(std::lower_bound(all_series[i].begin(), ord_end[idx], shift + 1), shift);
+        ord_iter[idx] = std::make_pair(transent_lower_bound(all_series[i].begin(), ord_end[idx], shift + 1), shift);
         ord_times[idx] = *(ord_iter[idx].first) - ord_iter[idx].second;
         ++idx;
       }
@@ -132,14 +581,40 @@ void transent_ho
       for (std::size_t k = 0; k < y_order; ++k) {
         shift = (window - 1) - y_delay - k;
         ord_end[idx] = all_series[j].end();
-        ord_iter[idx] = std::make_pair(std::lower_bound(all_series[j].begin(), ord_end[idx], shift + 1), shift);
+        ord_iter[idx] = std::make_pair(transent_lower_bound(all_series[j].begin(), ord_end[idx], shift + 1), shift);
         ord_times[idx] = *(ord_iter[idx].first) - ord_iter[idx].second;
         ++idx;
       }
 
       // Count spikes
-      std::fill(counts.begin(), counts.end(), 0);
-      cur_time = *(std::min_element(ord_times, ord_times + num_series));
+      if (dense_counts) {
+        std::fill(counts.begin(), counts.end(), 0);
+      }
+      else {
+
+        // Each spike ends at most one event
+        max_codes = 0;
+
+        for (std::size_t k = 0; k < num_series; ++k) {
+          max_codes += std::distance(ord_iter[k].first, ord_end[k]);
+        }
+
+        counter.clear(max_codes);
+      }
+
+      // Dense pairs are walked 64 time bins at a time (leaving nothing for
+      // the loop below), the rest one time per step
+      if (dense_counts) {
+        CodeTableCounter<TimeType> count_code(&counts[0]);
+        walked = transent_walk_bitmaps(all_series[i], all_series[j], x_order, y_order,
+                                       y_delay, end_time, count_code);
+      }
+      else {
+        walked = transent_walk_bitmaps(all_series[i], all_series[j], x_order, y_order,
+                                       y_delay, end_time, add_code);
+      }
+
+      cur_time = walked ? (end_time + 1) : *(std::min_element(ord_times, ord_times + num_series));
 
       while (cur_time <= end_time) {
 
@@ -167,40 +642,32 @@ void transent_ho
           }
         }
 
-        ++(counts[code.to_ulong()]);
+        if (dense_counts) {
+          ++(counts[code.to_ulong()]);
+        }
+        else {
+          counter.add((CodeType)code.to_ulong());
+        }
+
         cur_time = next_time;
 
       } // while spikes left
 
-      // Fill in zero count
-      counts[0] = end_time - std::accumulate(counts.begin() + 1, counts.end(), 0);
-
       // =====================================================================
 
       // Use counts to calculate TE
-      te_final = 0;
-
-      // Order is x^(k), y^(l), x(n+1)
-      for (std::size_t k = 0; k < num_counts; ++k) {
-        if (counts[k] == 0) {
-          continue;
-        }
-
-        prob_2 = (double)counts[k] / (double)(counts[k] + counts[k ^ 1]);
-
-        std::size_t c1 = 0, c2 = 0;
-        for (std::size_t l = 0; l < num_y; ++l) {
-          idx = (k & (num_x - 1)) + (l << (x_order + 1));
-          c1 += counts[idx];
-          c2 += (counts[idx] + counts[idx ^ 1]);
-        }
+      if (dense_counts) {
 
-        prob_3 = (double)c1 / (double)c2;
+        // Fill in zero count
+        counts[0] = end_time - std::accumulate(counts.begin() + 1, counts.end(), 0);
 
-        te_final += ((double)counts[k] * (log2(prob_2) - log2(prob_3)));
+        te_result[i - row_start][j - col_start] =
+          transent_from_counts(counts, x_order, y_order, end_time);
+      }
+      else {
+        te_result[i - row_start][j - col_start] =
+          counter.transent(x_order, y_order, end_time);
       }
-
-      te_result[i - row_start][j - col_start] = te_final / (double)end_time;
 
     } // for j
 
@@ -208,7 +675,172 @@ void transent_ho
 
 } //transent_ho
 
+// Returns a pointer to the first time of a series stored contiguously, or
+// null if the series layout is unknown.
+template <typename TimeType>
+const TimeType* transent_contiguous(const TimeType* iter) {
+  return (iter);
+}
+
+template <typename Iterator>
+const typename std::iterator_traits<Iterator>::value_type* transent_contiguous(Iterator) {
+  return (0);
+}
+
+template <typename TimeType>
+const TimeType* transent_contiguous_data(const std::vector<TimeType>& series) {
+  return (series.data());
+}
+
+template <typename TimeSeries>
+const typename TimeSeries::value_type* transent_contiguous_data(const TimeSeries& series) {
+  return (transent_contiguous(series.begin()));
+}
+
+// Counts the y spikes in [y_iter, y_last) that coincide with x(n), x(n+1) and
+// both, where x(n) is the x series shifted back by past_shift and x(n+1) the
+// same shifted by one more bin. Results are added to coincidences[0..2]. The x
+// series must be followed by a terminating element (x_last is its end).
+template <typename XIter, typename YIter, typename TimeType>
+void transent_1_coincidences
+(XIter x_iter, XIter /* x_last */, YIter y_iter, YIter y_last,
+ const TimeType past_shift, std::size_t* coincidences) {
+
+  std::size_t past_y = 0, future_y = 0, all_y = 0;
+  TimeType x_time = *x_iter - past_shift;
+
+  while (y_iter < y_last) {
+    const TimeType y_time = *y_iter;
+    const std::size_t x_step = (x_time < y_time),
+                      y_step = 1 - x_step,
+                      past_hit = y_step & (x_time == y_time);
+
+    std::size_t future_hit = y_step & (x_time == y_time + 1);
+
+    // Both x(n) and x(n+1) can only be set if the next x spike follows
+    // immediately (rare, so a branch is cheap here)
+    if (past_hit) {
+      future_hit = (*(x_iter + 1) - past_shift == y_time + 1);
+    }
+
+    past_y += past_hit;
+    future_y += future_hit;
+    all_y += (past_hit & future_hit);
+
+    x_iter += x_step;
+    y_iter += y_step;
+
+    x_time = *x_iter - past_shift;
+  }
+
+  coincidences[0] += past_y;
+  coincidences[1] += future_y;
+  coincidences[2] += all_y;
+}
+
+#ifdef __SSE2__
+// SSE2 version for contiguous int series. Blocks of 4 x and 4 y spikes are
+// compared all-against-all (4 rotations of the x block), and the block with
+// the smaller last spike is advanced, so each step covers up to 4 spikes with
+// no data-dependent branches. Matches of a y block are collected as lane
+// masks until it is retired, then counted.
+inline void transent_1_coincidences
+(const int* x_iter, const int* x_last, const int* y_iter, const int* y_last,
+ const int past_shift, std::size_t* coincidences) {
+
+  static const unsigned char mask_bits[16] = { 0, 1, 1, 2, 1, 2, 2, 3,
+                                               1, 2, 2, 3, 2, 3, 3, 4 };
+
+  const __m128i shift = _mm_set1_epi32(past_shift),
+                one = _mm_set1_epi32(1);
+
+  __m128i past_mask = _mm_setzero_si128(),
+          future_mask = _mm_setzero_si128();
+
+  std::size_t past_y = 0, future_y = 0, all_y = 0;
+
+  while (((x_iter + 4) <= x_last) && ((y_iter + 4) <= y_last)) {
+    const __m128i x_block = _mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x_iter)), shift),
+                  y_block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y_iter)),
+                  y_next = _mm_add_epi32(y_block, one),
+                  x_rot1 = _mm_shuffle_epi32(x_block, _MM_SHUFFLE(0, 3, 2, 1)),
+                  x_rot2 = _mm_shuffle_epi32(x_block, _MM_SHUFFLE(1, 0, 3, 2)),
+                  x_rot3 = _mm_shuffle_epi32(x_block, _MM_SHUFFLE(2, 1, 0, 3));
+
+    past_mask = _mm_or_si128(past_mask,
+                  _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi32(y_block, x_block),
+                                            _mm_cmpeq_epi32(y_block, x_rot1)),
+                               _mm_or_si128(_mm_cmpeq_epi32(y_block, x_rot2),
+                                            _mm_cmpeq_epi32(y_block, x_rot3))));
+
+    future_mask = _mm_or_si128(future_mask,
+                    _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi32(y_next, x_block),
+                                              _mm_cmpeq_epi32(y_next, x_rot1)),
+                                 _mm_or_si128(_mm_cmpeq_epi32(y_next, x_rot2),
+                                              _mm_cmpeq_epi32(y_next, x_rot3))));
+
+    // Retire the y block once the x block has moved past it (x(n+1) of the
+    // last y spike may still be in the next x block otherwise)
+    const int y_done = ((x_iter[3] - past_shift) > y_iter[3]);
+    const int retire = -y_done;
+
+    const int past_bits = _mm_movemask_ps(_mm_castsi128_ps(past_mask)) & retire,
+              future_bits = _mm_movemask_ps(_mm_castsi128_ps(future_mask)) & retire;
+
+    past_y += mask_bits[past_bits];
+    future_y += mask_bits[future_bits];
+    all_y += mask_bits[past_bits & future_bits];
+
+    const __m128i keep = _mm_set1_epi32(y_done - 1);
+    past_mask = _mm_and_si128(past_mask, keep);
+    future_mask = _mm_and_si128(future_mask, keep);
+
+    x_iter += 4 * (1 - y_done);
+    y_iter += 4 * y_done;
+  }
+
+  // Remaining spikes, starting with the partially compared y block
+  const int past_bits = _mm_movemask_ps(_mm_castsi128_ps(past_mask)),
+            future_bits = _mm_movemask_ps(_mm_castsi128_ps(future_mask));
+
+  for (std::size_t k = 0; y_iter < y_last; ++y_iter, ++k) {
+    const int y_time = *y_iter;
+
+    while ((*x_iter - past_shift) < y_time) {
+      ++x_iter;
+    }
+
+    const std::size_t block_past = (k < 4) && ((past_bits >> k) & 1),
+                      block_future = (k < 4) && ((future_bits >> k) & 1),
+                      past_hit = block_past | ((*x_iter - past_shift) == y_time),
+                      future_hit = block_future |
+                                   ((*x_iter - past_shift) == (y_time + 1)) |
+                                   (((*x_iter - past_shift) == y_time) &&
+                                    ((*(x_iter + 1) - past_shift) == (y_time + 1)));
+
+    past_y += past_hit;
+    future_y += future_hit;
+    all_y += (past_hit & future_hit);
+  }
+
+  coincidences[0] += past_y;
+  coincidences[1] += future_y;
+  coincidences[2] += all_y;
+}
+#endif
+
 // Computes the 1st order transfer entropy matrix for all pairs.
+//
+// This is a dedicated version of transent_ho<..., 1, 1> with the same
+// results. Instead of merging three streams (x(n+1), x(n), y), the joint
+// counts are derived by inclusion-exclusion from
+//   - single and x(n+1) & x(n) counts, computed once per predicted series,
+//   - y counts, computed once per predictor series,
+//   - y & x(n+1), y & x(n) and triple coincidences, found with a single
+//     branchless merge of the x and y spikes per pair.
+// All counts stay in registers. The merge relies on a terminating element:
+// every time series must be followed by a value greater than duration (e.g.
+// INT_MAX, see example.cpp), and the iterators must be random access.
 template <typename TimeSeriesCollection, typename ResultMatrix>
 void transent_1
 (const TimeSeriesCollection& all_series,
@@ -218,9 +850,100 @@ void transent_1
  std::size_t row_start = 0, std::size_t rows = 0,
  std::size_t col_start = 0, std::size_t cols = 0) {
 
-  return (transent_ho<TimeSeriesCollection, ResultMatrix, 1, 1>
-          (all_series, y_delay, duration, te_result,
-           row_start, rows, col_start, cols));
+  // Typedefs
+  typedef typename TimeSeriesCollection::value_type TimeSeries;
+  typedef typename TimeSeries::value_type TimeType;
+  typedef typename TimeSeries::const_iterator TimeSeriesIter;
+
+  assert(y_delay > 0);
+
+  if (rows == 0) {
+    rows = all_series.size();
+  }
+
+  if (cols == 0) {
+    cols = all_series.size();
+  }
+
+  // Code time t covers y(t), x(t + y_delay - 1) and x(t + y_delay)
+  const TimeType past_shift = y_delay - 1,
+                 end_time = duration - y_delay;
+
+  // y counts only depend on the predictor series
+  std::vector<std::size_t> y_counts(cols);
+
+  for (std::size_t j = 0; j < cols; ++j) {
+    y_counts[j] = std::upper_bound(all_series[col_start + j].begin(),
+                                   all_series[col_start + j].end(), end_time) -
+                  all_series[col_start + j].begin();
+  }
+
+  std::size_t counts[8];
+
+  // Calculate TE
+  for (std::size_t i = row_start; i < (rows + row_start); ++i) {
+
+    // x counts only depend on the predicted series. x(n) covers spikes in
+    // [y_delay, duration - 1] and x(n+1) spikes in [y_delay + 1, duration].
+    const TimeSeriesIter x_begin =
+      std::lower_bound(all_series[i].begin(), all_series[i].end(), y_delay);
+    const TimeSeriesIter x_end =
+      std::upper_bound(x_begin, all_series[i].end(), duration);
+
+    const std::size_t x_all = x_end - x_begin,
+                      x_first = ((x_all > 0) && (*x_begin == y_delay)) ? 1 : 0,
+                      x_last = ((x_all > 0) && (*(x_end - 1) == duration)) ? 1 : 0,
+                      future_count = x_all - x_first,
+                      past_count = x_all - x_last;
+
+    std::size_t both_count = 0;
+    for (TimeSeriesIter x_iter = x_begin; (x_iter + 1) < x_end; ++x_iter) {
+      both_count += (*(x_iter + 1) - *x_iter == 1);
+    }
+
+    const TimeType* x_data = transent_contiguous_data(all_series[i]);
+    const std::size_t x_size = all_series[i].size();
+
+    for (std::size_t j = col_start; j < (cols + col_start); ++j) {
+
+      // Count coincidences of y with x(n) and x(n+1)
+      const std::size_t y_count = y_counts[j - col_start];
+      const TimeType* y_data = transent_contiguous_data(all_series[j]);
+      std::size_t coincidences[3] = { 0, 0, 0 };
+
+      if (x_data && y_data) {
+        transent_1_coincidences(x_data + (x_begin - all_series[i].begin()),
+                                x_data + x_size, y_data, y_data + y_count,
+                                past_shift, coincidences);
+      }
+      else {
+        transent_1_coincidences(x_begin, all_series[i].end(),
+                                all_series[j].begin(), all_series[j].begin() + y_count,
+                                past_shift, coincidences);
+      }
+
+      const std::size_t past_y = coincidences[0],
+                        future_y = coincidences[1],
+                        all_y = coincidences[2];
+
+      // Inclusion-exclusion (code bit 0 is x(n+1), bit 1 is x(n), bit 2 is y)
+
+      counts[7] = all_y;
+      counts[3] = both_count - all_y;
+      counts[5] = future_y - all_y;
+      counts[6] = past_y - all_y;
+      counts[1] = future_count - both_count - future_y + all_y;
+      counts[2] = past_count - both_count - past_y + all_y;
+      counts[4] = y_count - future_y - past_y + all_y;
+      counts[0] = end_time - (counts[1] + counts[2] + counts[3] +
+                              counts[4] + counts[5] + counts[6] + counts[7]);
+
+      te_result[i - row_start][j - col_start] =
+        transent_from_counts(counts, 1, 1, end_time);
+
+    } // for j
+
+  } // for i
 
 } // transent_1
 
@@ -288,22 +1011,28 @@ void transent_ho
       for (std::size_t k = 0; k < (x_order + 1); ++k) {
         shift = (window - 1) - k;
         ord_end[idx] = all_series[i].end();
-        ord_iter[idx] = std::make_pair(std::lower_bound(all_series[i].begin(), ord_end[idx], shift + 1), shift);
+        ord_iter[idx] = std::make_pair(transent_lower_bound(all_series[i].begin(), ord_end[idx], shift + 1), shift);
         ord_times[idx] = *(ord_iter[idx].first) - ord_iter[idx].second;
         ++idx;
       }
 
-      // y^(l)
+      // y^(l), delayed as in the compile-time transent_ho
       for (std::size_t k = 0; k < y_order; ++k) {
+        shift = (window - 1) - y_delay - k;
         ord_end[idx] = all_series[j].end();
-        ord_iter[idx] = std::make_pair(all_series[j].begin(), -k);
+        ord_iter[idx] = std::make_pair(transent_lower_bound(all_series[j].begin(), ord_end[idx], shift + 1), shift);
         ord_times[idx] = *(ord_iter[idx].first) - ord_iter[idx].second;
         ++idx;
       }
 
-      // Count spikes
+      // Count spikes, 64 time bins at a time for dense pairs (leaving nothing
+      // for the loop below)
       std::fill(counts.begin(), counts.end(), 0);
-      cur_time = *(std::min_element(ord_times, ord_times + num_series));
+
+      CodeTableCounter<TimeType> count_code(&counts[0]);
+      cur_time = transent_walk_bitmaps(all_series[i], all_series[j], x_order, y_order,
+                                       y_delay, end_time, count_code) ?
+                 (end_time + 1) : *(std::min_element(ord_times, ord_times + num_series));
 
       while (cur_time <= end_time) {
 
@@ -372,3 +1101,1752 @@ void transent_ho
 
 } // transent_ho
 
+// =============================================================================
+// Building blocks for kernels that need more than the final TE value.
+// =============================================================================
+
+// Walks the joint code of x^(k+1), y^(l) for a single pair of time series
+// (with the same history layout as the compile-time transent_ho) and calls
+// visit(time, code) for every time in [1, end_time] whose code is nonzero, in
+// increasing order. A code at time t covers the original time bins
+// t .. t + window - 1, where window = max(y_order + y_delay, x_order + 1).
+// Dense pairs are walked with transent_walk_bitmaps.
+template <typename TimeSeries, typename CodeVisitor>
+void transent_walk_codes
+(const TimeSeries& x_series, const TimeSeries& y_series,
+ const std::size_t x_order, const std::size_t y_order,
+ const typename TimeSeries::value_type y_delay,
+ const typename TimeSeries::value_type end_time,
+ CodeVisitor& visit) {
+
+  // Typedefs
+  typedef typename TimeSeries::value_type TimeType;
+  typedef typename TimeSeries::const_iterator TimeSeriesIter;
+
+  // Constants
+  const std::size_t num_series = 1 + y_order + x_order;
+  const std::size_t window = std::max(y_order + y_delay, x_order + 1);
+
+  assert(x_order > 0);
+  assert(y_order > 0);
+  assert(y_delay > 0);
+  assert(num_series <= MAX_XY_ORDER);
+
+  if (transent_walk_bitmaps(x_series, y_series, x_order, y_order, y_delay, end_time, visit)) {
+    return;
+  }
+
+  // Locals
+  TimeSeriesIter ord_iter[MAX_XY_ORDER], ord_end[MAX_XY_ORDER];
+  TimeType ord_times[MAX_XY_ORDER], ord_shift[MAX_XY_ORDER];
+  TimeType cur_time, next_time;
+  std::size_t code;
+
+  // Order is x^(k+1), y^(l)
+  cur_time = std::numeric_limits<TimeType>::max();
+
+  for (std::size_t k = 0; k < num_series; ++k) {
+    const TimeSeries& series = (k < (x_order + 1)) ? x_series : y_series;
+
+    ord_shift[k] = (k < (x_order + 1)) ? ((window - 1) - k)
+                                       : ((window - 1) - y_delay - (k - x_order - 1));
+    ord_end[k] = series.end();
+    ord_iter[k] = transent_lower_bound(series.begin(), ord_end[k], ord_shift[k] + 1);
+    ord_times[k] = (ord_iter[k] == ord_end[k]) ? std::numeric_limits<TimeType>::max()
+                                               : *(ord_iter[k]) - ord_shift[k];
+    cur_time = std::min(cur_time, ord_times[k]);
+  }
+
+  while (cur_time <= end_time) {
+
+    code = 0;
+    next_time = std::numeric_limits<TimeType>::max();
+
+    for (std::size_t k = 0; k < num_series; ++k) {
+      if (ord_times[k] == cur_time) {
+        code |= ((std::size_t)1 << k);
+
+        // Next spike
+        ++(ord_iter[k]);
+
+        if (ord_iter[k] == ord_end[k]) {
+          ord_times[k] = std::numeric_limits<TimeType>::max();
+        }
+        else {
+          ord_times[k] = *(ord_iter[k]) - ord_shift[k];
+        }
+      }
+
+      if (ord_times[k] < next_time) {
+        next_time = ord_times[k];
+      }
+    }
+
+    visit(cur_time, code);
+    cur_time = next_time;
+
+  } // while spikes left
+
+} // transent_walk_codes
+
+// =============================================================================
+// Spike-count alphabets
+// =============================================================================
+
+// Same walk as transent_walk_codes, but every bin is a symbol 0 ..
+// alphabet - 1: the number of spikes in it (repeated times in a series),
+// saturated at alphabet - 1, so alphabet 4 distinguishes 0, 1, 2 and 3+
+// spikes. Codes are mixed radix with digit k (in the order x^(k+1), y^(l))
+// worth alphabet^k, so digit 0 is x(n+1). With alphabet 2 and no repeated
+// times, the codes are those of transent_walk_codes.
+template <typename TimeSeries, typename CodeVisitor>
+void transent_walk_symbols
+(const TimeSeries& x_series, const TimeSeries& y_series,
+ const std::size_t x_order, const std::size_t y_order,
+ const typename TimeSeries::value_type y_delay,
+ const typename TimeSeries::value_type end_time,
+ const std::size_t alphabet,
+ CodeVisitor& visit) {
+
+  // Typedefs
+  typedef typename TimeSeries::value_type TimeType;
+  typedef typename TimeSeries::const_iterator TimeSeriesIter;
+
+  // Constants
+  const std::size_t num_series = 1 + y_order + x_order;
+  const std::size_t window = std::max(y_order + y_delay, x_order + 1);
+
+  assert(x_order > 0);
+  assert(y_order > 0);
+  assert(y_delay > 0);
+  assert(alphabet >= 2);
+  assert(num_series <= MAX_XY_ORDER);
+
+  // Locals
+  TimeSeriesIter ord_iter[MAX_XY_ORDER], ord_end[MAX_XY_ORDER];
+  TimeType ord_times[MAX_XY_ORDER], ord_shift[MAX_XY_ORDER];
+  std::size_t place[MAX_XY_ORDER];
+  TimeType cur_time, next_time;
+  std::size_t code, spikes;
+
+  // Order is x^(k+1), y^(l)
+  cur_time = std::numeric_limits<TimeType>::max();
+
+  for (std::size_t k = 0; k < num_series; ++k) {
+    const TimeSeries& series = (k < (x_order + 1)) ? x_series : y_series;
+
+    place[k] = (k == 0) ? 1 : (place[k - 1] * alphabet);
+    ord_shift[k] = (k < (x_order + 1)) ? ((window - 1) - k)
+                                       : ((window - 1) - y_delay - (k - x_order - 1));
+    ord_end[k] = series.end();
+    ord_iter[k] = transent_lower_bound(series.begin(), ord_end[k], ord_shift[k] + 1);
+    ord_times[k] = (ord_iter[k] == ord_end[k]) ? std::numeric_limits<TimeType>::max()
+                                               : *(ord_iter[k]) - ord_shift[k];
+    cur_time = std::min(cur_time, ord_times[k]);
+  }
+
+  while (cur_time <= end_time) {
+
+    code = 0;
+    next_time = std::numeric_limits<TimeType>::max();
+
+    for (std::size_t k = 0; k < num_series; ++k) {
+      if (ord_times[k] == cur_time) {
+
+        // Spikes in this bin
+        spikes = 0;
+
+        do {
+          ++spikes;
+          ++(ord_iter[k]);
+        } while ((ord_iter[k] != ord_end[k]) && (*(ord_iter[k]) - ord_shift[k] == cur_time));
+
+        code += std::min(spikes, alphabet - 1) * place[k];
+
+        if (ord_iter[k] == ord_end[k]) {
+          ord_times[k] = std::numeric_limits<TimeType>::max();
+        }
+        else {
+          ord_times[k] = *(ord_iter[k]) - ord_shift[k];
+        }
+      }
+
+      if (ord_times[k] < next_time) {
+        next_time = ord_times[k];
+      }
+    }
+
+    visit(cur_time, code);
+    cur_time = next_time;
+
+  } // while spikes left
+
+} // transent_walk_symbols
+
+// Computes transfer entropy from a table of alphabet^(1 + x_order + y_order)
+// mixed-radix code counts (see transent_walk_symbols), with the zero code
+// filled in. For alphabet 2 this is transent_from_counts.
+template <typename CountTable>
+double transent_from_symbol_counts
+(const CountTable& counts,
+ const std::size_t x_order, const std::size_t y_order,
+ const std::size_t alphabet,
+ const double total) {
+
+  std::size_t num_counts = 1, num_x = 1;
+
+  for (std::size_t k = 0; k < (1 + x_order + y_order); ++k) {
+    num_counts *= alphabet;
+    num_x *= (k <= x_order) ? alphabet : 1;
+  }
+
+  // Marginal counts of x^(k+1)
+  std::vector<double> x_counts(num_x);
+
+  for (std::size_t k = 0; k < num_counts; ++k) {
+    x_counts[k % num_x] += counts[k];
+  }
+
+  double te_final = 0, prob_2, prob_3, next_total, x_total;
+  std::size_t x_code, first, x_first;
+
+  for (std::size_t k = 0; k < num_counts; ++k) {
+    if (counts[k] == 0) {
+      continue;
+    }
+
+    // Sum over every symbol of x(n+1) with the same history
+    x_code = k % num_x;
+    first = k - (k % alphabet);
+    x_first = x_code - (x_code % alphabet);
+    next_total = 0;
+    x_total = 0;
+
+    for (std::size_t a = 0; a < alphabet; ++a) {
+      next_total += counts[first + a];
+      x_total += x_counts[x_first + a];
+    }
+
+    prob_2 = (double)counts[k] / next_total;
+    prob_3 = x_counts[x_code] / x_total;
+
+    te_final += ((double)counts[k] * (log2(prob_2) - log2(prob_3)));
+  }
+
+  return ((total > 0) ? (te_final / total) : 0);
+
+} // transent_from_symbol_counts
+
+// Computes the higher-order transfer entropy matrix over spike-count symbols
+// (see transent_walk_symbols): repeated times in a series count as several
+// spikes in one bin, e.g. after rebinning without removing duplicates. The
+// counts table has alphabet^(1 + x_order + y_order) entries. With alphabet 2,
+// the result is that of the compile-time transent_ho on the de-duplicated
+// series.
+template <typename TimeSeriesCollection, typename ResultMatrix>
+void transent_ho_symbols
+(const TimeSeriesCollection& all_series,
+ const std::size_t x_order, const std::size_t y_order,
+ const typename TimeSeriesCollection::value_type::value_type y_delay,
+ const typename TimeSeriesCollection::value_type::value_type duration,
+ const std::size_t alphabet,
+ ResultMatrix& te_result,
+ std::size_t row_start = 0, std::size_t rows = 0,
+ std::size_t col_start = 0, std::size_t cols = 0) {
+
+  typedef typename TimeSeriesCollection::value_type::value_type TimeType;
+
+  if (rows == 0) {
+    rows = all_series.size();
+  }
+
+  if (cols == 0) {
+    cols = all_series.size();
+  }
+
+  std::size_t num_counts = 1;
+
+  for (std::size_t k = 0; k < (1 + x_order + y_order); ++k) {
+    num_counts *= alphabet;
+  }
+
+  const std::size_t window = std::max(y_order + y_delay, x_order + 1);
+  const TimeType end_time = duration - window + 1;
+
+  std::vector<boost::uint32_t> counts(num_counts);
+
+  for (std::size_t i = 0; i < rows; ++i) {
+    for (std::size_t j = 0; j < cols; ++j) {
+
+      std::fill(counts.begin(), counts.end(), 0);
+      CodeTableCounter<boost::uint32_t> counter(&counts[0]);
+
+      transent_walk_symbols(all_series[row_start + i], all_series[col_start + j],
+                            x_order, y_order, y_delay, end_time, alphabet, counter);
+
+      counts[0] = end_time - counter.nonzero;
+
+      te_result[i][j] =
+        transent_from_symbol_counts(counts, x_order, y_order, alphabet, end_time);
+
+    } // for j
+
+  } // for i
+
+} // transent_ho_symbols
+
+// =============================================================================
+// Joint count tables
+// =============================================================================
+
+// Computes the same matrix as transent_ho_symbols and passes the joint count
+// table of every pair to sink(i, j, counts, codes) in row-major order, with
+// block-relative i and j. counts is the dense table of
+// alphabet^(1 + x_order + y_order) entries with the zero code filled in, and
+// codes lists its nonzero entries in increasing order.
+template <typename TimeSeriesCollection, typename ResultMatrix, typename CountSink>
+void transent_ho_count_tables
+(const TimeSeriesCollection& all_series,
+ const std::size_t x_order, const std::size_t y_order,
+ const typename TimeSeriesCollection::value_type::value_type y_delay,
+ const typename TimeSeriesCollection::value_type::value_type duration,
+ const std::size_t alphabet,
+ CountSink& sink,
+ ResultMatrix& te_result,
+ std::size_t row_start = 0, std::size_t rows = 0,
+ std::size_t col_start = 0, std::size_t cols = 0) {
+
+  typedef typename TimeSeriesCollection::value_type::value_type TimeType;
+
+  if (rows == 0) {
+    rows = all_series.size();
+  }
+
+  if (cols == 0) {
+    cols = all_series.size();
+  }
+
+  std::size_t num_counts = 1;
+
+  for (std::size_t k = 0; k < (1 + x_order + y_order); ++k) {
+    num_counts *= alphabet;
+  }
+
+  const std::size_t window = std::max(y_order + y_delay, x_order + 1);
+  const TimeType end_time = duration - window + 1;
+
+  std::vector<boost::uint32_t> counts(num_counts);
+  std::vector<std::size_t> codes;
+
+  for (std::size_t i = 0; i < rows; ++i) {
+    for (std::size_t j = 0; j < cols; ++j) {
+
+      std::fill(counts.begin(), counts.end(), 0);
+      CodeTableCounter<boost::uint32_t> counter(&counts[0]);
+
+      transent_walk_symbols(all_series[row_start + i], all_series[col_start + j],
+                            x_order, y_order, y_delay, end_time, alphabet, counter);
+
+      counts[0] = end_time - counter.nonzero;
+      codes.clear();
+
+      for (std::size_t k = 0; k < num_counts; ++k) {
+        if (counts[k] != 0) {
+          codes.push_back(k);
+        }
+      }
+
+      te_result[i][j] =
+        transent_from_symbol_counts(counts, x_order, y_order, alphabet, end_time);
+
+      sink(i, j, counts, codes);
+
+    } // for j
+
+  } // for i
+
+} // transent_ho_count_tables
+
+// =============================================================================
+// Local transfer entropy
+// =============================================================================
+
+// Local (pointwise) transfer entropy of a pair: the contribution
+// log2(p(x(n+1) | x^(k), y^(l)) / p(x(n+1) | x^(k))) of every time bin, whose
+// average over all bins is the transfer entropy. values[t] belongs to bin
+// times[t] of the predicted x(n+1), where some involved bin has a spike; all
+// other bins in window .. duration have the code 0 and the value zero_value.
+template <typename TimeType>
+struct TransentLocalSeries {
+  double zero_value, average;
+  std::vector<TimeType> times;
+  std::vector<double> values;
+
+  TransentLocalSeries() : zero_value(0), average(0) { }
+};
+
+// Fills local[k] with the local transfer entropy of every nonzero code k of a
+// table of mixed-radix code counts (see transent_from_symbol_counts). Other
+// entries are 0.
+template <typename CountTable>
+void transent_local_table
+(const CountTable& counts,
+ const std::size_t x_order, const std::size_t y_order,
+ const std::size_t alphabet,
+ std::vector<double>& local) {
+
+  std::size_t num_counts = 1, num_x = 1;
+
+  for (std::size_t k = 0; k < (1 + x_order + y_order); ++k) {
+    num_counts *= alphabet;
+    num_x *= (k <= x_order) ? alphabet : 1;
+  }
+
+  std::vector<double> x_counts(num_x);
+
+  for (std::size_t k = 0; k < num_counts; ++k) {
+    x_counts[k % num_x] += counts[k];
+  }
+
+  local.assign(num_counts, 0);
+
+  double next_total, x_total;
+  std::size_t x_code, first, x_first;
+
+  for (std::size_t k = 0; k < num_counts; ++k) {
+    if (counts[k] == 0) {
+      continue;
+    }
+
+    x_code = k % num_x;
+    first = k - (k % alphabet);
+    x_first = x_code - (x_code % alphabet);
+    next_total = 0;
+    x_total = 0;
+
+    for (std::size_t a = 0; a < alphabet; ++a) {
+      next_total += counts[first + a];
+      x_total += x_counts[x_first + a];
+    }
+
+    local[k] = log2((double)counts[k] / next_total) - log2(x_counts[x_code] / x_total);
+  }
+
+} // transent_local_table
+
+// Records the local value of every visited code at the bin of x(n+1)
+template <typename TimeType>
+struct LocalRecorder {
+  const double* local;
+  TimeType shift;
+  TransentLocalSeries<TimeType>* series;
+
+  template <typename CodeTime>
+  void operator()(CodeTime time, std::size_t code) {
+    series->times.push_back(time + shift);
+    series->values.push_back(local[code]);
+  }
+};
+
+// Computes the local transfer entropy of one pair (y -> x) in two passes: the
+// first counts the codes (as transent_ho_symbols, alphabet 2 for binary
+// codes), the second turns every nonzero code into its local value.
+template <typename TimeSeries>
+void transent_local
+(const TimeSeries& x_series, const TimeSeries& y_series,
+ const std::size_t x_order, const std::size_t y_order,
+ const typename TimeSeries::value_type y_delay,
+ const typename TimeSeries::value_type duration,
+ const std::size_t alphabet,
+ TransentLocalSeries<typename TimeSeries::value_type>& series) {
+
+  typedef typename TimeSeries::value_type TimeType;
+
+  std::size_t num_counts = 1;
+
+  for (std::size_t k = 0; k < (1 + x_order + y_order); ++k) {
+    num_counts *= alphabet;
+  }
+
+  const std::size_t window = std::max(y_order + y_delay, x_order + 1);
+  const TimeType end_time = duration - window + 1;
+
+  // Counts
+  std::vector<boost::uint32_t> counts(num_counts);
+  CodeTableCounter<boost::uint32_t> counter(&counts[0]);
+
+  transent_walk_symbols(x_series, y_series, x_order, y_order, y_delay, end_time,
+                        alphabet, counter);
+
+  counts[0] = end_time - counter.nonzero;
+
+  std::vector<double> local;
+  transent_local_table(counts, x_order, y_order, alphabet, local);
+
+  // Local values
+  series.times.clear();
+  series.values.clear();
+  series.times.reserve(counter.nonzero);
+  series.values.reserve(counter.nonzero);
+  series.zero_value = local[0];
+
+  LocalRecorder<TimeType> recorder = { &local[0], (TimeType)(window - 1), &series };
+
+  transent_walk_symbols(x_series, y_series, x_order, y_order, y_delay, end_time,
+                        alphabet, recorder);
+
+  double total = local[0] * counts[0];
+
+  for (std::size_t t = 0; t < series.values.size(); ++t) {
+    total += series.values[t];
+  }
+
+  series.average = (end_time > 0) ? (total / end_time) : 0;
+
+} // transent_local
+
+// =============================================================================
+// Non-uniform embeddings
+// =============================================================================
+
+// Number of lags in a lag mask, where bit (a - 1) stands for lag a
+template <std::size_t mask>
+struct LagMaskSize {
+  static const std::size_t value = (mask & 1) + LagMaskSize<(mask >> 1)>::value;
+};
+
+template <>
+struct LagMaskSize<0> {
+  static const std::size_t value = 0;
+};
+
+// Lags of a lag mask in increasing order
+inline void transent_mask_lags(std::size_t mask, std::vector<std::size_t>& lags) {
+  lags.clear();
+
+  for (std::size_t a = 1; mask != 0; ++a, mask >>= 1) {
+    if (mask & 1) {
+      lags.push_back(a);
+    }
+  }
+}
+
+// Window of a lag embedding: 1 + the largest lag
+template <typename LagCollection>
+std::size_t transent_lag_window(const LagCollection& x_lags,
+                                const LagCollection& y_lags) {
+  std::size_t window = 1;
+
+  for (std::size_t k = 0; k < x_lags.size(); ++k) {
+    window = std::max(window, (std::size_t)x_lags[k] + 1);
+  }
+
+  for (std::size_t k = 0; k < y_lags.size(); ++k) {
+    window = std::max(window, (std::size_t)y_lags[k] + 1);
+  }
+
+  return (window);
+}
+
+// Walks the joint code of x(n+1), x at x_lags and y at y_lags for one pair of
+// time series and calls visit(time, code) for every nonzero code, like
+// transent_walk_codes. Lags count time bins back from the predicted bin n+1
+// and must be at least 1. Code bit 0 is x(n+1), the next bits are the x lags
+// and then the y lags, in the given order. A code at time t covers the bins
+// t .. t + window - 1 with window = 1 + the largest lag. x_lags 1..x_order and
+// y_lags y_delay .. y_delay + y_order - 1 give the codes of
+// transent_walk_codes. A nonzero fixed_series is the number of lags + 1 known
+// at compile time, so the loops over the series can be unrolled.
+template <std::size_t fixed_series, typename TimeSeries, typename LagCollection,
+          typename CodeVisitor>
+void transent_walk_lag_codes
+(const TimeSeries& x_series, const TimeSeries& y_series,
+ const LagCollection& x_lags, const LagCollection& y_lags,
+ const typename TimeSeries::value_type end_time,
+ CodeVisitor& visit) {
+
+  // Typedefs
+  typedef typename TimeSeries::value_type TimeType;
+  typedef typename TimeSeries::const_iterator TimeSeriesIter;
+
+  // Constants
+  const std::size_t num_x = 1 + x_lags.size(),
+                    num_series = (fixed_series > 0) ? fixed_series : (num_x + y_lags.size());
+
+  assert(num_series == (num_x + y_lags.size()));
+  assert(num_series <= MAX_XY_ORDER);
+
+  const std::size_t window = transent_lag_window(x_lags, y_lags);
+
+  assert(std::find(x_lags.begin(), x_lags.end(), 0) == x_lags.end());
+  assert(std::find(y_lags.begin(), y_lags.end(), 0) == y_lags.end());
+
+  // Locals
+  TimeSeriesIter ord_iter[MAX_XY_ORDER], ord_end[MAX_XY_ORDER];
+  TimeType ord_times[MAX_XY_ORDER], ord_shift[MAX_XY_ORDER];
+  TimeType cur_time, next_time;
+  std::size_t code;
+
+  // Order is x(n+1), x lags, y lags
+  cur_time = std::numeric_limits<TimeType>::max();
+
+  for (std::size_t k = 0; k < num_series; ++k) {
+    const TimeSeries& series = (k < num_x) ? x_series : y_series;
+
+    ord_shift[k] = (window - 1) - ((k == 0) ? 0 : ((k < num_x) ? x_lags[k - 1] : y_lags[k - num_x]));
+    ord_end[k] = series.end();
+    ord_iter[k] = transent_lower_bound(series.begin(), ord_end[k], ord_shift[k] + 1);
+    ord_times[k] = (ord_iter[k] == ord_end[k]) ? std::numeric_limits<TimeType>::max()
+                                               : *(ord_iter[k]) - ord_shift[k];
+    cur_time = std::min(cur_time, ord_times[k]);
+  }
+
+  while (cur_time <= end_time) {
+
+    code = 0;
+    next_time = std::numeric_limits<TimeType>::max();
+
+    for (std::size_t k = 0; k < num_series; ++k) {
+      if (ord_times[k] == cur_time) {
+        code |= ((std::size_t)1 << k);
+
+        // Next spike
+        ++(ord_iter[k]);
+
+        if (ord_iter[k] == ord_end[k]) {
+          ord_times[k] = std::numeric_limits<TimeType>::max();
+        }
+        else {
+          ord_times[k] = *(ord_iter[k]) - ord_shift[k];
+        }
+      }
+
+      if (ord_times[k] < next_time) {
+        next_time = ord_times[k];
+      }
+    }
+
+    visit(cur_time, code);
+    cur_time = next_time;
+
+  } // while spikes left
+
+} // transent_walk_lag_codes
+
+// Computes the transfer entropy matrix with x and y histories taken at
+// arbitrary lags (see transent_walk_lag_codes), known at run time. The count
+// table has 2^(1 + x_lags.size() + y_lags.size()) entries however long the
+// lags are, so dependencies at e.g. lags {1, 3, 10, 30} need 2^5 codes rather
+// than 2^31.
+template <typename TimeSeriesCollection, typename ResultMatrix>
+void transent_ho_lags
+(const TimeSeriesCollection& all_series,
+ const std::vector<std::size_t>& x_lags,
+ const std::vector<std::size_t>& y_lags,
+ const typename TimeSeriesCollection::value_type::value_type duration,
+ ResultMatrix& te_result,
+ std::size_t row_start = 0, std::size_t rows = 0,
+ std::size_t col_start = 0, std::size_t cols = 0) {
+
+  typedef typename TimeSeriesCollection::value_type::value_type TimeType;
+
+  assert(!x_lags.empty());
+  assert(!y_lags.empty());
+  assert((1 + x_lags.size() + y_lags.size()) <= 32);
+
+  if (rows == 0) {
+    rows = all_series.size();
+  }
+
+  if (cols == 0) {
+    cols = all_series.size();
+  }
+
+  const TimeType end_time = duration - (TimeType)transent_lag_window(x_lags, y_lags) + 1;
+  std::vector<boost::uint32_t> counts((std::size_t)1 << (1 + x_lags.size() + y_lags.size()));
+
+  for (std::size_t i = 0; i < rows; ++i) {
+    for (std::size_t j = 0; j < cols; ++j) {
+
+      std::fill(counts.begin(), counts.end(), 0);
+      CodeTableCounter<boost::uint32_t> counter(&counts[0]);
+
+      transent_walk_lag_codes<0>(all_series[row_start + i], all_series[col_start + j],
+                                 x_lags, y_lags, end_time, counter);
+
+      counts[0] = end_time - counter.nonzero;
+
+      te_result[i][j] = transent_from_counts(counts, x_lags.size(), y_lags.size(), end_time);
+
+    } // for j
+
+  } // for i
+
+} // transent_ho_lags
+
+// Computes the transfer entropy matrix with lag sets fixed at compile time:
+// bit (a - 1) of x_mask (y_mask) selects x (y) lag a. The table size and the
+// number of series are compile-time constants, so the code walk is
+// specialised for the masks.
+// Results are identical to the run-time overload with the same lags.
+template <typename TimeSeriesCollection, typename ResultMatrix,
+          std::size_t x_mask, std::size_t y_mask>
+void transent_ho_lags
+(const TimeSeriesCollection& all_series,
+ const typename TimeSeriesCollection::value_type::value_type duration,
+ ResultMatrix& te_result,
+ std::size_t row_start = 0, std::size_t rows = 0,
+ std::size_t col_start = 0, std::size_t cols = 0) {
+
+  typedef typename TimeSeriesCollection::value_type::value_type TimeType;
+
+  // Constants
+  const std::size_t x_order = LagMaskSize<x_mask>::value,
+                    y_order = LagMaskSize<y_mask>::value,
+                    num_series = 1 + x_order + y_order,
+                    num_counts = (std::size_t)1 << num_series;
+
+  BOOST_STATIC_ASSERT(x_order > 0);
+  BOOST_STATIC_ASSERT(y_order > 0);
+  BOOST_STATIC_ASSERT(num_series <= TRANSENT_TABLE_CODE_BITS);
+
+  if (rows == 0) {
+    rows = all_series.size();
+  }
+
+  if (cols == 0) {
+    cols = all_series.size();
+  }
+
+  std::vector<std::size_t> x_lags, y_lags;
+  transent_mask_lags(x_mask, x_lags);
+  transent_mask_lags(y_mask, y_lags);
+
+  const TimeType end_time = duration - (TimeType)transent_lag_window(x_lags, y_lags) + 1;
+  std::vector<boost::uint32_t> counts(num_counts);
+
+  for (std::size_t i = 0; i < rows; ++i) {
+    for (std::size_t j = 0; j < cols; ++j) {
+
+      std::fill(counts.begin(), counts.end(), 0);
+      CodeTableCounter<boost::uint32_t> counter(&counts[0]);
+
+      transent_walk_lag_codes<num_series>(all_series[row_start + i], all_series[col_start + j],
+                                          x_lags, y_lags, end_time, counter);
+
+      counts[0] = end_time - counter.nonzero;
+
+      te_result[i][j] = transent_from_counts(counts, x_order, y_order, end_time);
+
+    } // for j
+
+  } // for i
+
+} // transent_ho_lags
+
+// =============================================================================
+// Trial-segmented transfer entropy
+// =============================================================================
+
+// Accumulates code counts separately for each trial. Trials are sorted,
+// non-overlapping, 1-based [start, end] intervals (edges included, as in
+// ASDFChooseTime). Only codes whose whole window lies inside a trial count.
+template <typename TimeType, typename CountType>
+struct TrialCounter {
+  const std::vector< std::pair<TimeType, TimeType> >& valid;
+  CountType* counts;
+  std::size_t num_counts, trial;
+
+  TrialCounter(const std::vector< std::pair<TimeType, TimeType> >& valid_times,
+               CountType* trial_counts, std::size_t counts_per_trial) :
+    valid(valid_times), counts(trial_counts),
+    num_counts(counts_per_trial), trial(0) { }
+
+  void operator()(TimeType time, std::size_t code) {
+    while ((trial < valid.size()) && (time > valid[trial].second)) {
+      ++trial;
+    }
+
+    if ((trial < valid.size()) && (time >= valid[trial].first)) {
+      ++(counts[(trial * num_counts) + code]);
+    }
+  }
+};
+
+// Computes the higher-order transfer entropy matrix for all pairs, pooling
+// the code counts of a list of trials in a single pass per pair. No history
+// crosses a trial boundary. Histories are laid out as in the compile-time
+// transent_ho.
+//
+// If trial_counts is given, it is resized to hold the per-trial count tables
+// of every pair, laid out as
+//   [(pair * trials.size()) + trial][code]
+// with pair = ((i - row_start) * cols) + (j - col_start) and
+// (2 ^ (1 + x_order + y_order)) codes per table.
+template <typename TimeSeriesCollection, typename ResultMatrix>
+void transent_ho_trials
+(const TimeSeriesCollection& all_series,
+ const std::size_t x_order, const std::size_t y_order,
+ const typename TimeSeriesCollection::value_type::value_type y_delay,
+ const std::vector< std::pair<typename TimeSeriesCollection::value_type::value_type,
+                              typename TimeSeriesCollection::value_type::value_type> >& trials,
+ ResultMatrix& te_result,
+ std::size_t row_start = 0, std::size_t rows = 0,
+ std::size_t col_start = 0, std::size_t cols = 0,
+ std::vector<typename TimeSeriesCollection::value_type::value_type>* trial_counts = 0) {
+
+  // Typedefs
+  typedef typename TimeSeriesCollection::value_type TimeSeries;
+  typedef typename TimeSeries::value_type TimeType;
+  typedef std::pair<TimeType, TimeType> Interval;
+
+  // Constants
+  const std::size_t num_series = 1 + y_order + x_order,
+                    num_counts = (std::size_t)1 << num_series,
+                    num_trials = trials.size();
+
+  assert(num_series <= MAX_XY_ORDER);
+
+  if (rows == 0) {
+    rows = all_series.size();
+  }
+
+  if (cols == 0) {
+    cols = all_series.size();
+  }
+
+  // Valid code times for each trial
+  const TimeType window = std::max(y_order + y_delay, x_order + 1);
+  std::vector<Interval> valid(num_trials);
+  TimeType end_time = 0, valid_total = 0;
+
+  for (std::size_t t = 0; t < num_trials; ++t) {
+    assert((t == 0) || (trials[t].first > trials[t - 1].second));
+
+    valid[t] = Interval(trials[t].first, trials[t].second - window + 1);
+    valid_total += std::max(valid[t].second - valid[t].first + 1, 0);
+    end_time = std::max(end_time, valid[t].second);
+  }
+
+  // Locals
+  std::vector<TimeType> pair_counts(num_trials * num_counts), counts(num_counts);
+  TimeType* out_counts = 0;
+
+  if (trial_counts) {
+    trial_counts->assign(rows * cols * num_trials * num_counts, 0);
+  }
+
+  // Calculate TE
+  for (std::size_t i = row_start; i < (rows + row_start); ++i) {
+    for (std::size_t j = col_start; j < (cols + col_start); ++j) {
+
+      if (trial_counts) {
+        out_counts = &(*trial_counts)[(((i - row_start) * cols) + (j - col_start)) * num_trials * num_counts];
+      }
+      else {
+        std::fill(pair_counts.begin(), pair_counts.end(), 0);
+        out_counts = &pair_counts[0];
+      }
+
+      // Count spikes
+      TrialCounter<TimeType, TimeType> counter(valid, out_counts, num_counts);
+      transent_walk_codes(all_series[i], all_series[j], x_order, y_order,
+                          y_delay, end_time, counter);
+
+      // Fill in zero counts and pool trials
+      std::fill(counts.begin(), counts.end(), 0);
+
+      for (std::size_t t = 0; t < num_trials; ++t) {
+        TimeType* cur_counts = out_counts + (t * num_counts);
+
+        cur_counts[0] = std::max(valid[t].second - valid[t].first + 1, 0) -
+                        std::accumulate(cur_counts + 1, cur_counts + num_counts, 0);
+
+        for (std::size_t k = 0; k < num_counts; ++k) {
+          counts[k] += cur_counts[k];
+        }
+      }
+
+      te_result[i - row_start][j - col_start] =
+        transent_from_counts(counts, x_order, y_order, valid_total);
+
+    } // for j
+
+  } // for i
+
+} // transent_ho_trials
+
+// =============================================================================
+// Time-resolved transfer entropy
+// =============================================================================
+
+// Per-segment code counts for a block of pairs, stored as prefix sums so the
+// counts of any run of whole segments are the difference of two tables.
+// Segment s holds the codes at times (s * segment_length) + 1 ..
+// (s + 1) * segment_length, i.e. the history windows starting in those bins.
+// Only the nonzero codes that a pair produces at least once get a column in
+// its tables, so a pair takes (segments + 1) * (its distinct codes) counts
+// instead of (segments + 1) * 2^(1 + x_order + y_order); the zero code is
+// derived from the number of bins.
+class SegmentCountIndex {
+public:
+  typedef boost::uint32_t CountType;
+
+  SegmentCountIndex() :
+    x_order_(0), y_order_(0), segment_length_(0), end_time_(0),
+    segments_(0), rows_(0), cols_(0) { }
+
+  std::size_t x_order() const { return (x_order_); }
+  std::size_t y_order() const { return (y_order_); }
+  std::size_t segment_length() const { return (segment_length_); }
+  std::size_t segments() const { return (segments_); }
+  std::size_t rows() const { return (rows_); }
+  std::size_t cols() const { return (cols_); }
+
+  // Number of time bins (code times) in segments [first, last)
+  std::size_t bins(std::size_t first, std::size_t last) const {
+    return (std::min(last * segment_length_, end_time_) - std::min(first * segment_length_, end_time_));
+  }
+
+  // Transfer entropy for block-relative pair (i, j) over segments [first, last)
+  double transent(std::size_t i, std::size_t j,
+                  std::size_t first, std::size_t last) const {
+
+    assert(first <= last && last <= segments_);
+
+    const std::size_t pair = (i * cols_) + j,
+                      active = pair_first_[pair + 1] - pair_first_[pair];
+    const std::size_t* codes = codes_.data() + pair_first_[pair];
+    const CountType* first_table = table(pair, first);
+    const CountType* last_table = table(pair, last);
+
+    std::vector<std::size_t> counts((std::size_t)1 << (1 + x_order_ + y_order_));
+    const std::size_t total = bins(first, last);
+    std::size_t nonzero = 0;
+
+    for (std::size_t a = 0; a < active; ++a) {
+      counts[codes[a]] = last_table[a] - first_table[a];
+      nonzero += counts[codes[a]];
+    }
+
+    counts[0] = total - nonzero;
+
+    return (transent_from_counts(counts, x_order_, y_order_, total));
+  }
+
+  // Transfer entropy for the whole block over segments [first, last)
+  template <typename ResultMatrix>
+  void transent(std::size_t first, std::size_t last,
+                ResultMatrix& te_result) const {
+
+    for (std::size_t i = 0; i < rows_; ++i) {
+      for (std::size_t j = 0; j < cols_; ++j) {
+        te_result[i][j] = transent(i, j, first, last);
+      }
+    }
+  }
+
+  // Sets up an empty index; pairs are then added in row-major order
+  void reset(std::size_t x_order, std::size_t y_order,
+             std::size_t segment_length, std::size_t end_time,
+             std::size_t rows, std::size_t cols) {
+    x_order_ = x_order;
+    y_order_ = y_order;
+    segment_length_ = segment_length;
+    end_time_ = end_time;
+    segments_ = (end_time + segment_length - 1) / segment_length;
+    rows_ = rows;
+    cols_ = cols;
+
+    codes_.clear();
+    prefix_.clear();
+    pair_first_.assign(1, 0);
+    pair_first_.reserve((rows * cols) + 1);
+  }
+
+  // Adds the next pair from its (segment, nonzero code) events
+  void add_pair(const std::vector< std::pair<std::size_t, std::size_t> >& events) {
+    const std::size_t first_code = codes_.size(),
+                      code_bits = 1 + x_order_ + y_order_;
+
+    // Columns of the distinct codes: looked up in a table of all codes when
+    // it is small enough, found by binary search otherwise
+    const bool lookup = (code_bits <= TRANSENT_TABLE_CODE_BITS);
+
+    if (lookup) {
+      column_.resize((std::size_t)1 << code_bits, 0);
+
+      for (std::size_t e = 0; e < events.size(); ++e) {
+        if (column_[events[e].second] == 0) {
+          column_[events[e].second] = 1;
+          codes_.push_back(events[e].second);
+        }
+      }
+    }
+    else {
+      for (std::size_t e = 0; e < events.size(); ++e) {
+        codes_.push_back(events[e].second);
+      }
+    }
+
+    std::sort(codes_.begin() + first_code, codes_.end());
+    codes_.erase(std::unique(codes_.begin() + first_code, codes_.end()), codes_.end());
+
+    const std::size_t active = codes_.size() - first_code;
+    const std::size_t* codes = codes_.data() + first_code;
+    pair_first_.push_back(codes_.size());
+
+    if (lookup) {
+      for (std::size_t a = 0; a < active; ++a) {
+        column_[codes[a]] = a;
+      }
+    }
+
+    // Segment counts (table s + 1 holds segment s), then prefix sums
+    const std::size_t first_count = prefix_.size();
+    prefix_.resize(first_count + ((segments_ + 1) * active), 0);
+
+    CountType* tables = prefix_.data() + first_count;
+
+    for (std::size_t e = 0; e < events.size(); ++e) {
+      const std::size_t a = lookup ? column_[events[e].second] :
+        (std::lower_bound(codes, codes + active, events[e].second) - codes);
+      ++(tables[((events[e].first + 1) * active) + a]);
+    }
+
+    for (std::size_t k = active; k < ((segments_ + 1) * active); ++k) {
+      tables[k] += tables[k - active];
+    }
+
+    if (lookup) {
+      for (std::size_t a = 0; a < active; ++a) {
+        column_[codes[a]] = 0;
+      }
+    }
+  }
+
+  // Stored counts and codes, in bytes
+  std::size_t bytes() const {
+    return ((prefix_.size() * sizeof(CountType)) + (codes_.size() * sizeof(std::size_t)) +
+            (pair_first_.size() * sizeof(std::size_t)));
+  }
+
+private:
+  // Prefix table (counts of segments [0, segment)) for block-relative pair
+  const CountType* table(std::size_t pair, std::size_t segment) const {
+    return (prefix_.data() + (pair_first_[pair] * (segments_ + 1)) +
+            (segment * (pair_first_[pair + 1] - pair_first_[pair])));
+  }
+
+  std::size_t x_order_, y_order_, segment_length_, end_time_;
+  std::size_t segments_, rows_, cols_;
+
+  // Codes of pair p are codes_[pair_first_[p] .. pair_first_[p + 1]), and its
+  // tables start at prefix_[pair_first_[p] * (segments_ + 1)]
+  std::vector<std::size_t> codes_, pair_first_;
+  std::vector<CountType> prefix_;
+
+  // Column of every code of the pair being added (all 0 in between)
+  std::vector<boost::uint32_t> column_;
+};
+
+// Records the (segment, code) of every visited code
+struct SegmentEventRecorder {
+  std::vector< std::pair<std::size_t, std::size_t> >* events;
+  std::size_t segment_length;
+
+  template <typename TimeType>
+  void operator()(TimeType time, std::size_t code) {
+    events->push_back(std::make_pair(((std::size_t)time - 1) / segment_length, code));
+  }
+};
+
+// Counts codes into consecutive dense segment tables (one table of all
+// nonzero codes per segment).
+struct SegmentCounter {
+  SegmentCountIndex::CountType* tables;
+  std::size_t segment_length, codes;
+
+  SegmentCounter(SegmentCountIndex::CountType* first_table,
+                 std::size_t length, std::size_t nonzero_codes) :
+    tables(first_table), segment_length(length), codes(nonzero_codes) { }
+
+  template <typename TimeType>
+  void operator()(TimeType time, std::size_t code) {
+    ++(tables[((((std::size_t)time - 1) / segment_length) * codes) + (code - 1)]);
+  }
+};
+
+// Builds a segment count index for a block of pairs in a single pass per
+// pair. Histories are laid out as in the compile-time transent_ho. Windows
+// of whole segments can then be evaluated with SegmentCountIndex::transent at
+// the cost of a table difference.
+template <typename TimeSeriesCollection>
+void transent_segment_index
+(const TimeSeriesCollection& all_series,
+ const std::size_t x_order, const std::size_t y_order,
+ const typename TimeSeriesCollection::value_type::value_type y_delay,
+ const typename TimeSeriesCollection::value_type::value_type duration,
+ const std::size_t segment_length,
+ SegmentCountIndex& index,
+ std::size_t row_start = 0, std::size_t rows = 0,
+ std::size_t col_start = 0, std::size_t cols = 0) {
+
+  typedef typename TimeSeriesCollection::value_type::value_type TimeType;
+
+  assert(segment_length > 0);
+  assert((1 + x_order + y_order) <= 32);
+
+  if (rows == 0) {
+    rows = all_series.size();
+  }
+
+  if (cols == 0) {
+    cols = all_series.size();
+  }
+
+  const std::size_t window = std::max(y_order + y_delay, x_order + 1);
+  const TimeType end_time = duration - window + 1;
+
+  index.reset(x_order, y_order, segment_length, std::max(end_time, (TimeType)0), rows, cols);
+
+  std::vector< std::pair<std::size_t, std::size_t> > events;
+  SegmentEventRecorder recorder = { &events, segment_length };
+
+  for (std::size_t i = 0; i < rows; ++i) {
+    for (std::size_t j = 0; j < cols; ++j) {
+
+      events.clear();
+      transent_walk_codes(all_series[row_start + i], all_series[col_start + j],
+                          x_order, y_order, y_delay, end_time, recorder);
+
+      index.add_pair(events);
+
+    } // for j
+
+  } // for i
+
+} // transent_segment_index
+
+// =============================================================================
+// Resampled confidence intervals
+// =============================================================================
+
+enum TransentResampling {
+  RESAMPLE_JACKKNIFE,
+  RESAMPLE_BOOTSTRAP
+};
+
+// Transfer entropy of one pair with the spread of its segment resamples
+struct TransentInterval {
+  double estimate;  // over all segments
+  double mean;      // of the resampled values
+  double std_error;
+  double lower, upper;
+
+  TransentInterval() :
+    estimate(0), mean(0), std_error(0), lower(0), upper(0) { }
+};
+
+// Draws how often each of segments is picked in each bootstrap replicate:
+// weights[(b * segments) + s]. The same weights are used for every pair so
+// replicates of different pairs resample the same stretches of time.
+inline void transent_bootstrap_weights(std::size_t segments,
+                                       std::size_t replicates,
+                                       boost::uint32_t seed,
+                                       std::vector<boost::uint32_t>& weights) {
+
+  boost::random::mt19937 generator(seed);
+  boost::random::uniform_int_distribution<std::size_t> pick(0, segments - 1);
+
+  weights.assign(segments * replicates, 0);
+
+  for (std::size_t b = 0; b < replicates; ++b) {
+    for (std::size_t s = 0; s < segments; ++s) {
+      ++(weights[(b * segments) + pick(generator)]);
+    }
+  }
+}
+
+// Linearly interpolated quantile of sorted values
+inline double transent_quantile(const std::vector<double>& sorted, double q) {
+  if (sorted.empty()) {
+    return (0);
+  }
+
+  const double position = q * (double)(sorted.size() - 1);
+  const std::size_t below = (std::size_t)position;
+
+  if (below + 1 >= sorted.size()) {
+    return (sorted.back());
+  }
+
+  const double fraction = position - (double)below;
+  return ((sorted[below] * (1 - fraction)) + (sorted[below + 1] * fraction));
+}
+
+// Estimates transfer entropy and its uncertainty for a block of pairs by
+// resampling whole segments of segment_length bins. Codes are counted once per
+// pair into one table per segment; every resample is then a weighted sum of
+// those tables, so the series are walked no more often than for
+// transent_ho. Jackknife leaves out one segment at a time and reports a normal
+// interval (estimate +/- z * SE); bootstrap draws replicates segments with
+// replacement (weights from transent_bootstrap_weights) and reports the
+// percentile interval. te_intervals[i][j] holds a TransentInterval.
+template <typename TimeSeriesCollection, typename IntervalMatrix>
+void transent_ho_intervals
+(const TimeSeriesCollection& all_series,
+ const std::size_t x_order, const std::size_t y_order,
+ const typename TimeSeriesCollection::value_type::value_type y_delay,
+ const typename TimeSeriesCollection::value_type::value_type duration,
+ const std::size_t segment_length,
+ const TransentResampling resampling,
+ const std::size_t replicates,
+ const double confidence,
+ const boost::uint32_t seed,
+ IntervalMatrix& te_intervals,
+ std::size_t row_start = 0, std::size_t rows = 0,
+ std::size_t col_start = 0, std::size_t cols = 0) {
+
+  typedef typename TimeSeriesCollection::value_type::value_type TimeType;
+  typedef SegmentCountIndex::CountType CountType;
+
+  assert(segment_length > 0);
+  assert((1 + x_order + y_order) <= 32);
+  assert(confidence > 0 && confidence < 1);
+
+  if (rows == 0) {
+    rows = all_series.size();
+  }
+
+  if (cols == 0) {
+    cols = all_series.size();
+  }
+
+  const std::size_t window = std::max(y_order + y_delay, x_order + 1);
+  const std::size_t end_time = (std::size_t)std::max(duration - (TimeType)window + 1, (TimeType)0);
+  const std::size_t segments = std::max((end_time + segment_length - 1) / segment_length, (std::size_t)1);
+  const std::size_t codes = ((std::size_t)1 << (1 + x_order + y_order)) - 1;
+
+  // Bins per segment (the last one may be short)
+  std::vector<double> segment_bins(segments);
+
+  for (std::size_t s = 0; s < segments; ++s) {
+    segment_bins[s] = (double)(std::min((s + 1) * segment_length, end_time) -
+                               std::min(s * segment_length, end_time));
+  }
+
+  std::vector<boost::uint32_t> weights;
+  std::vector<double> replicate_bins;
+  std::size_t samples = segments;
+
+  if (resampling == RESAMPLE_BOOTSTRAP) {
+    transent_bootstrap_weights(segments, replicates, seed, weights);
+    samples = replicates;
+    replicate_bins.assign(replicates, 0);
+
+    for (std::size_t b = 0; b < replicates; ++b) {
+      for (std::size_t s = 0; s < segments; ++s) {
+        replicate_bins[b] += weights[(b * segments) + s] * segment_bins[s];
+      }
+    }
+  }
+
+  const boost::math::normal standard_normal;
+  const double alpha = 1 - confidence,
+               z = boost::math::quantile(standard_normal, 1 - (alpha / 2));
+
+  std::vector<CountType> tables(segments * codes);
+  std::vector<double> total(codes + 1), counts(codes + 1), values(samples);
+  std::vector<double> compact, sums;
+  std::vector<std::size_t> active;
+
+  for (std::size_t i = 0; i < rows; ++i) {
+    for (std::size_t j = 0; j < cols; ++j) {
+
+      std::fill(tables.begin(), tables.end(), 0);
+      SegmentCounter counter(&tables[0], segment_length, codes);
+      transent_walk_codes(all_series[row_start + i], all_series[col_start + j],
+                          x_order, y_order, y_delay, (TimeType)end_time, counter);
+
+      // Whole-series counts, and the codes that occur at all
+      std::fill(total.begin(), total.end(), 0);
+      active.clear();
+
+      for (std::size_t s = 0; s < segments; ++s) {
+        const CountType* table = &tables[s * codes];
+        for (std::size_t k = 0; k < codes; ++k) {
+          total[k + 1] += table[k];
+        }
+      }
+
+      double nonzero = 0;
+      for (std::size_t k = 0; k < codes; ++k) {
+        if (total[k + 1] > 0) {
+          active.push_back(k);
+          nonzero += total[k + 1];
+        }
+      }
+
+      total[0] = (double)end_time - nonzero;
+
+      // Segment tables of the occurring codes only, for the bootstrap sums
+      if (resampling == RESAMPLE_BOOTSTRAP) {
+        compact.resize(segments * active.size());
+        sums.resize(active.size());
+
+        for (std::size_t s = 0; s < segments; ++s) {
+          for (std::size_t a = 0; a < active.size(); ++a) {
+            compact[(s * active.size()) + a] = tables[(s * codes) + active[a]];
+          }
+        }
+      }
+
+      TransentInterval& interval = te_intervals[i][j];
+      interval.estimate = transent_from_counts(total, x_order, y_order, (double)end_time);
+
+      // Resampled values, only touching codes that occur
+      for (std::size_t r = 0; r < samples; ++r) {
+        double bins = 0;
+        nonzero = 0;
+
+        if (resampling == RESAMPLE_JACKKNIFE) {
+          const CountType* table = &tables[r * codes];
+          bins = (double)end_time - segment_bins[r];
+
+          for (std::size_t a = 0; a < active.size(); ++a) {
+            const std::size_t k = active[a];
+            counts[k + 1] = total[k + 1] - table[k];
+            nonzero += counts[k + 1];
+          }
+        } else {
+          const boost::uint32_t* weight = &weights[r * segments];
+          bins = replicate_bins[r];
+          std::fill(sums.begin(), sums.end(), 0);
+
+          for (std::size_t s = 0; s < segments; ++s) {
+            if (weight[s] == 0) {
+              continue;
+            }
+
+            const double w = weight[s], *table = &compact[s * active.size()];
+            for (std::size_t a = 0; a < active.size(); ++a) {
+              sums[a] += w * table[a];
+            }
+          }
+
+          for (std::size_t a = 0; a < active.size(); ++a) {
+            counts[active[a] + 1] = sums[a];
+            nonzero += sums[a];
+          }
+        }
+
+        counts[0] = bins - nonzero;
+        values[r] = transent_from_counts(counts, x_order, y_order, bins);
+
+      } // for r
+
+      double sum = 0, squares = 0;
+
+      for (std::size_t r = 0; r < samples; ++r) {
+        sum += values[r];
+      }
+
+      interval.mean = sum / (double)samples;
+
+      for (std::size_t r = 0; r < samples; ++r) {
+        squares += (values[r] - interval.mean) * (values[r] - interval.mean);
+      }
+
+      if (resampling == RESAMPLE_JACKKNIFE) {
+        interval.std_error = std::sqrt(squares * (double)(samples - 1) / (double)samples);
+        interval.lower = interval.estimate - (z * interval.std_error);
+        interval.upper = interval.estimate + (z * interval.std_error);
+      } else {
+        interval.std_error = (samples > 1) ? std::sqrt(squares / (double)(samples - 1)) : 0;
+        std::sort(values.begin(), values.end());
+        interval.lower = transent_quantile(values, alpha / 2);
+        interval.upper = transent_quantile(values, 1 - (alpha / 2));
+      }
+
+      // Codes absent from the whole series stay zero in every resample
+      for (std::size_t a = 0; a < active.size(); ++a) {
+        counts[active[a] + 1] = 0;
+      }
+
+    } // for j
+
+  } // for i
+
+} // transent_ho_intervals
+
+// =============================================================================
+// Sparse pair lists
+// =============================================================================
+
+// Orders the indices of a pair list by predicted, then predictor time series,
+// so consecutive pairs reuse the same predicted series.
+template <typename PairCollection>
+struct PairOrder {
+  const PairCollection& pairs;
+
+  PairOrder(const PairCollection& pair_list) : pairs(pair_list) { }
+
+  bool operator()(std::size_t a, std::size_t b) const {
+    return (pairs[a] < pairs[b]);
+  }
+};
+
+template <typename PairCollection>
+void transent_pair_order(const PairCollection& pairs,
+                         std::vector<std::size_t>& order) {
+  order.resize(pairs.size());
+
+  for (std::size_t p = 0; p < order.size(); ++p) {
+    order[p] = p;
+  }
+
+  std::sort(order.begin(), order.end(), PairOrder<PairCollection>(pairs));
+}
+
+// Builds the pair list for all combinations of predicted (row_ids) and
+// predictor (col_ids) time series.
+template <typename IndexCollection>
+void transent_pairs_from_sets
+(const IndexCollection& row_ids, const IndexCollection& col_ids,
+ std::vector< std::pair<std::size_t, std::size_t> >& pairs) {
+
+  pairs.clear();
+  pairs.reserve(row_ids.size() * col_ids.size());
+
+  for (std::size_t i = 0; i < row_ids.size(); ++i) {
+    for (std::size_t j = 0; j < col_ids.size(); ++j) {
+      pairs.push_back(std::make_pair((std::size_t)row_ids[i], (std::size_t)col_ids[j]));
+    }
+  }
+}
+
+// Computes the higher-order transfer entropy for an explicit list of
+// (predicted, predictor) pairs. te_values[p] receives the transfer entropy
+// for pairs[p]. Pairs are evaluated grouped by predicted time series. x and y
+// orders must be known at compile time.
+template <typename TimeSeriesCollection, typename PairCollection,
+          typename ResultVector, std::size_t x_order, std::size_t y_order>
+void transent_ho_pairs
+(const TimeSeriesCollection& all_series,
+ const typename TimeSeriesCollection::value_type::value_type y_delay,
+ const typename TimeSeriesCollection::value_type::value_type duration,
+ const PairCollection& pairs,
+ ResultVector& te_values) {
+
+  typedef double PairResult[1][1];
+
+  std::vector<std::size_t> order;
+  transent_pair_order(pairs, order);
+
+  PairResult te_pair;
+
+  for (std::size_t p = 0; p < order.size(); ++p) {
+    transent_ho<TimeSeriesCollection, PairResult, x_order, y_order>
+      (all_series, y_delay, duration, te_pair,
+       pairs[order[p]].first, 1, pairs[order[p]].second, 1);
+
+    te_values[order[p]] = te_pair[0][0];
+  }
+
+} // transent_ho_pairs
+
+// Computes the 1st order transfer entropy for an explicit list of
+// (predicted, predictor) pairs with transent_1 (see above).
+template <typename TimeSeriesCollection, typename PairCollection,
+          typename ResultVector>
+void transent_1_pairs
+(const TimeSeriesCollection& all_series,
+ const typename TimeSeriesCollection::value_type::value_type y_delay,
+ const typename TimeSeriesCollection::value_type::value_type duration,
+ const PairCollection& pairs,
+ ResultVector& te_values) {
+
+  typedef double PairResult[1][1];
+
+  std::vector<std::size_t> order;
+  transent_pair_order(pairs, order);
+
+  PairResult te_pair;
+
+  for (std::size_t p = 0; p < order.size(); ++p) {
+    transent_1(all_series, y_delay, duration, te_pair,
+               pairs[order[p]].first, 1, pairs[order[p]].second, 1);
+
+    te_values[order[p]] = te_pair[0][0];
+  }
+
+} // transent_1_pairs
+
+// Computes the higher-order transfer entropy for an explicit list of
+// (predicted, predictor) pairs (see above), with orders known at run time.
+template <typename TimeSeriesCollection, typename PairCollection,
+          typename ResultVector>
+void transent_ho_pairs
+(const TimeSeriesCollection& all_series,
+ const std::size_t x_order, const std::size_t y_order,
+ const typename TimeSeriesCollection::value_type::value_type y_delay,
+ const typename TimeSeriesCollection::value_type::value_type duration,
+ const PairCollection& pairs,
+ ResultVector& te_values) {
+
+  typedef double PairResult[1][1];
+
+  std::vector<std::size_t> order;
+  transent_pair_order(pairs, order);
+
+  PairResult te_pair;
+
+  for (std::size_t p = 0; p < order.size(); ++p) {
+    transent_ho(all_series, x_order, y_order, y_delay, duration, te_pair,
+                pairs[order[p]].first, 1, pairs[order[p]].second, 1);
+
+    te_values[order[p]] = te_pair[0][0];
+  }
+
+} // transent_ho_pairs
+
+// =============================================================================
+// Screening cascade
+// =============================================================================
+
+// Selects the pairs of a screened block that get a full calculation: for each
+// predicted time series (row), the pairs whose screen value is at least
+// threshold, and of those only the top_k largest if top_k > 0. screen holds
+// block-relative values; pairs receives absolute (predicted, predictor)
+// indices in row-major order.
+template <typename ScreenMatrix, typename PairCollection>
+void transent_screen_pairs(const ScreenMatrix& screen,
+                           const double threshold, const std::size_t top_k,
+                           PairCollection& pairs,
+                           std::size_t row_start, std::size_t rows,
+                           std::size_t col_start, std::size_t cols) {
+
+  std::vector< std::pair<double, std::size_t> > passed;
+  std::vector<std::size_t> predictors;
+
+  pairs.clear();
+
+  for (std::size_t i = 0; i < rows; ++i) {
+    passed.clear();
+
+    for (std::size_t j = 0; j < cols; ++j) {
+      if (screen[i][j] >= threshold) {
+        passed.push_back(std::make_pair(screen[i][j], j));
+      }
+    }
+
+    if ((top_k > 0) && (passed.size() > top_k)) {
+      std::nth_element(passed.begin(), passed.begin() + (top_k - 1), passed.end(),
+                       std::greater< std::pair<double, std::size_t> >());
+      passed.resize(top_k);
+    }
+
+    predictors.clear();
+
+    for (std::size_t p = 0; p < passed.size(); ++p) {
+      predictors.push_back(passed[p].second);
+    }
+
+    std::sort(predictors.begin(), predictors.end());
+
+    for (std::size_t p = 0; p < predictors.size(); ++p) {
+      pairs.push_back(std::make_pair(row_start + i, col_start + predictors[p]));
+    }
+  }
+
+} // transent_screen_pairs
+
+// Two-stage calculation for high orders: transent_1 is computed for the whole
+// block into screen_result (block-relative), then the compile-time
+// transent_ho only for the pairs chosen by transent_screen_pairs. pairs and
+// te_values receive the surviving pairs and their high-order transfer
+// entropy, so the cost of the second stage scales with the number of
+// survivors instead of rows * cols. The screen is not a bound: a pair with
+// weak first-order but strong high-order transfer entropy is missed. Time
+// series must be terminated as for transent_1.
+template <typename TimeSeriesCollection, typename ScreenMatrix,
+          typename PairCollection, typename ResultVector,
+          std::size_t x_order, std::size_t y_order>
+void transent_ho_cascade
+(const TimeSeriesCollection& all_series,
+ const typename TimeSeriesCollection::value_type::value_type y_delay,
+ const typename TimeSeriesCollection::value_type::value_type duration,
+ const double threshold, const std::size_t top_k,
+ ScreenMatrix& screen_result,
+ PairCollection& pairs,
+ ResultVector& te_values,
+ std::size_t row_start = 0, std::size_t rows = 0,
+ std::size_t col_start = 0, std::size_t cols = 0) {
+
+  if (rows == 0) {
+    rows = all_series.size();
+  }
+
+  if (cols == 0) {
+    cols = all_series.size();
+  }
+
+  transent_1(all_series, y_delay, duration, screen_result,
+             row_start, rows, col_start, cols);
+
+  transent_screen_pairs(screen_result, threshold, top_k, pairs,
+                        row_start, rows, col_start, cols);
+
+  te_values.resize(pairs.size());
+
+  transent_ho_pairs<TimeSeriesCollection, PairCollection, ResultVector, x_order, y_order>
+    (all_series, y_delay, duration, pairs, te_values);
+
+} // transent_ho_cascade
+
+// Index of a time series with no usable entry in a previous result
+#define TRANSENT_NO_PREVIOUS (~(std::size_t)0)
+
+// Updates a full transfer entropy matrix after time series were added,
+// removed or changed, with orders known at run time. previous_index[i] is the
+// index in previous_result (the full matrix of the previous time series) of
+// time series i, or TRANSENT_NO_PREVIOUS if it is new or its times changed.
+// Pairs of two unchanged time series are copied from previous_result, and only
+// the rows and columns of the other time series are calculated, so the cost is
+// O(changed * N) rather than O(N^2). Returns the number of calculated pairs.
+template <typename TimeSeriesCollection, typename PreviousMatrix,
+          typename ResultMatrix>
+std::size_t transent_ho_update
+(const TimeSeriesCollection& all_series,
+ const std::size_t x_order, const std::size_t y_order,
+ const typename TimeSeriesCollection::value_type::value_type y_delay,
+ const typename TimeSeriesCollection::value_type::value_type duration,
+ const PreviousMatrix& previous_result,
+ const std::vector<std::size_t>& previous_index,
+ ResultMatrix& te_result) {
+
+  const std::size_t series_count = all_series.size();
+  assert(previous_index.size() == series_count);
+
+  std::vector<std::size_t> changed;
+
+  for (std::size_t i = 0; i < series_count; ++i) {
+    if (previous_index[i] == TRANSENT_NO_PREVIOUS) {
+      changed.push_back(i);
+    }
+  }
+
+  // Whole rows of changed time series
+  std::vector< std::vector<double> > row_result(1, std::vector<double>(series_count));
+
+  for (std::size_t c = 0; c < changed.size(); ++c) {
+    transent_ho(all_series, x_order, y_order, y_delay, duration, row_result,
+                changed[c], 1, 0, series_count);
+
+    for (std::size_t j = 0; j < series_count; ++j) {
+      te_result[changed[c]][j] = row_result[0][j];
+    }
+  }
+
+  // Columns of changed time series in unchanged rows, and the rest of those
+  // rows from the previous result
+  std::vector< std::pair<std::size_t, std::size_t> > pairs;
+
+  for (std::size_t i = 0; i < series_count; ++i) {
+    if (previous_index[i] == TRANSENT_NO_PREVIOUS) {
+      continue;
+    }
+
+    for (std::size_t j = 0; j < series_count; ++j) {
+      if (previous_index[j] == TRANSENT_NO_PREVIOUS) {
+        pairs.push_back(std::make_pair(i, j));
+      }
+      else {
+        te_result[i][j] = previous_result[previous_index[i]][previous_index[j]];
+      }
+    }
+  }
+
+  std::vector<double> te_values(pairs.size());
+
+  transent_ho_pairs(all_series, x_order, y_order, y_delay, duration,
+                    pairs, te_values);
+
+  for (std::size_t p = 0; p < pairs.size(); ++p) {
+    te_result[pairs[p].first][pairs[p].second] = te_values[p];
+  }
+
+  return ((changed.size() * series_count) + pairs.size());
+
+} // transent_ho_update
+
+// Returns an upper bound (in bits) of the entropy of one bin of any of the rows
+// time series starting at row_start, for codes over window bins: with q the
+// estimated probability of a nonzero symbol, at most
+// spikes / (duration - window + 1), the entropy is at most
+// H(q) + q * log2(alphabet - 1), which grows up to log2(alphabet) at
+// q = (alphabet - 1) / alphabet. Repeated times count as several spikes, as in
+// transent_ho_symbols.
+template <typename TimeSeriesCollection>
+double transent_entropy_bound
+(const TimeSeriesCollection& all_series, const std::size_t window,
+ const typename TimeSeriesCollection::value_type::value_type duration,
+ const std::size_t alphabet, std::size_t row_start, std::size_t rows) {
+
+  if (rows == 0) {
+    rows = all_series.size() - row_start;
+  }
+
+  const double end_time = (double)duration - window + 1,
+               max_q = (alphabet - 1) / (double)alphabet;
+  double bound = 0;
+
+  for (std::size_t i = row_start; i < (row_start + rows); ++i) {
+    const double q = std::min(max_q, all_series[i].size() / end_time);
+
+    if (q >= max_q) {
+      return (log2((double)alphabet));
+    }
+
+    if (q > 0) {
+      bound = std::max(bound, -(q * log2(q)) - ((1 - q) * log2(1 - q)) + (q * log2((double)(alphabet - 1))));
+    }
+  }
+
+  return (bound);
+
+} // transent_entropy_bound
+
+// Returns an upper bound (in bits) of the transfer entropy to any of the rows
+// predicted time series starting at row_start: the entropy of the next bin of
+// the predicted series, H(x(n+1)) >= H(x(n+1) | x(n)...) >= TE (see
+// transent_entropy_bound). alphabet is that of transent_ho_symbols (2 for
+// transent_ho).
+template <typename TimeSeriesCollection>
+double transent_upper_bound
+(const TimeSeriesCollection& all_series,
+ const std::size_t x_order, const std::size_t y_order,
+ const typename TimeSeriesCollection::value_type::value_type y_delay,
+ const typename TimeSeriesCollection::value_type::value_type duration,
+ std::size_t row_start = 0, std::size_t rows = 0, std::size_t alphabet = 2) {
+
+  return (transent_entropy_bound(all_series, std::max(y_order + y_delay, x_order + 1),
+                                 duration, alphabet, row_start, rows));
+
+} // transent_upper_bound
+
+// Same as transent_upper_bound for the histories at lags of transent_ho_lags
+template <typename TimeSeriesCollection, typename LagCollection>
+double transent_lags_upper_bound
+(const TimeSeriesCollection& all_series,
+ const LagCollection& x_lags, const LagCollection& y_lags,
+ const typename TimeSeriesCollection::value_type::value_type duration,
+ std::size_t row_start = 0, std::size_t rows = 0) {
+
+  return (transent_entropy_bound(all_series, transent_lag_window(x_lags, y_lags),
+                                 duration, 2, row_start, rows));
+
+} // transent_lags_upper_bound
+
+#endif // TRANSENT_HPP